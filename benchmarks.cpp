@@ -0,0 +1,232 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: benchmarks.cpp
+// Author: Guilherme R. Lampert
+// Created on: 29/08/26
+// Brief: Micro-benchmarks for the string classes. Build and run with 'make bench'.
+// ================================================================================================
+
+// For printf
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+
+// Counting allocation hooks so every benchmark can also report
+// how many bytes it requested. Must be defined before str.hpp.
+static unsigned long long g_alloc_calls = 0;
+static unsigned long long g_alloc_bytes = 0;
+
+static char * bench_mem_alloc(const std::size_t count)
+{
+    ++g_alloc_calls;
+    g_alloc_bytes += count;
+    return static_cast<char *>(std::malloc(count));
+}
+
+static char * bench_mem_realloc(void * ptr, const std::size_t count)
+{
+    ++g_alloc_calls;
+    g_alloc_bytes += count;
+    return static_cast<char *>(std::realloc(ptr, count));
+}
+
+#define STR_MEM_ALLOC(count)        bench_mem_alloc(count)
+#define STR_MEM_REALLOC(ptr, count) bench_mem_realloc(ptr, count)
+#define STR_MEM_FREE(ptr)           std::free(ptr)
+
+#define STR_IMPLEMENTATION
+#include "str.hpp"
+
+namespace benchmark
+{
+
+// Sink to keep the optimizer from discarding the benchmarked work.
+static volatile int g_sink = 0;
+
+using bench_clock = std::chrono::steady_clock;
+
+template<typename Fn>
+void run(const char * name, const int iterations, Fn fn)
+{
+    // Warm-up pass (first-touch allocations, caches):
+    fn();
+
+    g_alloc_calls = 0;
+    g_alloc_bytes = 0;
+
+    const auto time_start = bench_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        fn();
+    }
+    const auto time_end = bench_clock::now();
+
+    const double total_ns = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(time_end - time_start).count());
+
+    std::printf("%-46s %12.1f ns/op %10llu allocs %14llu bytes\n",
+                name, total_ns / iterations, g_alloc_calls, g_alloc_bytes);
+}
+
+// ========================================================
+// Construction/destruction of the str_sized aliases:
+// ========================================================
+
+template<typename T>
+void construct_destruct()
+{
+    T s{ "hello world" }; // Fits every local buffer size.
+    g_sink += s.length();
+}
+
+void bench_construction()
+{
+    const int iterations = 1000000;
+    run("construct/destruct str16",  iterations, construct_destruct<str16>);
+    run("construct/destruct str32",  iterations, construct_destruct<str32>);
+    run("construct/destruct str64",  iterations, construct_destruct<str64>);
+    run("construct/destruct str128", iterations, construct_destruct<str128>);
+    run("construct/destruct str256", iterations, construct_destruct<str256>);
+    run("construct/destruct str512", iterations, construct_destruct<str512>);
+    run("construct/destruct str (heap)", iterations, construct_destruct<str>);
+    run("construct/destruct std::string", iterations, construct_destruct<std::string>);
+}
+
+// ========================================================
+// Append loops at several target sizes:
+// ========================================================
+
+void append_loop(const int target_size)
+{
+    str s;
+    while (s.length() < target_size)
+    {
+        s += "12345678"; // 8 chars per append.
+    }
+    g_sink += s.length();
+}
+
+void append_loop_std(const int target_size)
+{
+    std::string s;
+    while (static_cast<int>(s.length()) < target_size)
+    {
+        s += "12345678";
+    }
+    g_sink += static_cast<int>(s.length());
+}
+
+void bench_append()
+{
+    run("append loop to 64 B (str)",          200000, []() { append_loop(64);          });
+    run("append loop to 64 B (std::string)",  200000, []() { append_loop_std(64);      });
+    run("append loop to 4 KB (str)",          20000,  []() { append_loop(4096);        });
+    run("append loop to 4 KB (std::string)",  20000,  []() { append_loop_std(4096);    });
+    run("append loop to 256 KB (str)",        500,    []() { append_loop(256 * 1024);  });
+    run("append loop to 256 KB (std::string)",500,    []() { append_loop_std(256 * 1024); });
+}
+
+// ========================================================
+// Searching on several haystack sizes:
+// ========================================================
+
+void make_haystack(str & s, const int size)
+{
+    s.reserve_discard(size + 1);
+    while (s.length() < size - 8)
+    {
+        s += "aabbccdd";
+    }
+    s += "needle!?"; // Match near the very end.
+}
+
+void bench_search()
+{
+    str hay64, hay4k, hay1m;
+    make_haystack(hay64, 64);
+    make_haystack(hay4k, 4 * 1024);
+    make_haystack(hay1m, 1024 * 1024);
+
+    run("first_index_of(char) 64 B",   500000, [&]() { g_sink += hay64.first_index_of('!');  });
+    run("first_index_of(char) 4 KB",   100000, [&]() { g_sink += hay4k.first_index_of('!');  });
+    run("first_index_of(char) 1 MB",   500,    [&]() { g_sink += hay1m.first_index_of('!');  });
+
+    run("first_index_of(substr) 64 B", 500000, [&]() { g_sink += hay64.first_index_of("needle");  });
+    run("first_index_of(substr) 4 KB", 100000, [&]() { g_sink += hay4k.first_index_of("needle");  });
+    run("first_index_of(substr) 1 MB", 500,    [&]() { g_sink += hay1m.first_index_of("needle");  });
+
+    run("last_index_of(substr) 1 MB",  500,    [&]() { g_sink += hay1m.last_index_of("aabbccdd"); });
+    run("find_any_matching_index 1 MB",500,    [&]() { g_sink += hay1m.find_any_matching_index("!?"); });
+}
+
+// ========================================================
+// Comparison:
+// ========================================================
+
+void bench_compare()
+{
+    const str64 a{ "some/moderately/long/key/string/here" };
+    const str64 b{ "some/moderately/long/key/string/here" };
+    const str64 c{ "some/moderately/long/key/string/ends-differently" };
+
+    run("operator== equal str64",      1000000, [&]() { g_sink += (a == b); });
+    run("operator== diff-length str64",1000000, [&]() { g_sink += (a == c); });
+    run("compare() equal str64",       1000000, [&]() { g_sink += a.compare(b); });
+}
+
+// ========================================================
+// Formatted output:
+// ========================================================
+
+void bench_format()
+{
+    str s;
+    run("setf(\"%d\")",   500000, [&]() { s.setf("%d", 123456789);  g_sink += s.length(); });
+    run("set_int()",      500000, [&]() { s.set_int(123456789);     g_sink += s.length(); });
+    run("setf(\"%x\")",   500000, [&]() { s.setf("%x", 0xABCDEF);   g_sink += s.length(); });
+    run("set_hex()",      500000, [&]() { s.set_hex(0xABCDEF);      g_sink += s.length(); });
+    run("setf(\"%.6f\")", 500000, [&]() { s.setf("%.6f", 3.141592); g_sink += s.length(); });
+    run("set_float()",    500000, [&]() { s.set_float(3.141592);    g_sink += s.length(); });
+}
+
+// ========================================================
+// Move/swap:
+// ========================================================
+
+void bench_move_swap()
+{
+    str heap_a{ "a string long enough to always live on the heap........." };
+    str heap_b{ "another string long enough to always live on the heap..." };
+    str32 small_a{ "small-a" };
+    str32 small_b{ "small-b" };
+
+    run("swap str (heap)",  1000000, [&]() { swap(heap_a, heap_b);   });
+    run("swap str32 (SSO)", 1000000, [&]() { swap(small_a, small_b); });
+    run("move str (heap)",  1000000, [&]() {
+        str tmp{ static_cast<str &&>(heap_a) };
+        heap_a = static_cast<str &&>(tmp);
+        g_sink += heap_a.length();
+    });
+}
+
+} // namespace benchmark {}
+
+// ========================================================
+// Benchmark suite entry point:
+// ========================================================
+
+int main()
+{
+    std::printf("---- Running micro-benchmarks for the str classes ----\n");
+
+    benchmark::bench_construction();
+    benchmark::bench_append();
+    benchmark::bench_search();
+    benchmark::bench_compare();
+    benchmark::bench_format();
+    benchmark::bench_move_swap();
+
+    std::printf("Done.\n");
+}
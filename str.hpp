@@ -32,6 +32,8 @@
     #include <string>
     #include <iterator>
     #include <type_traits>
+    #include <atomic>
+    #include <new>
 #endif // STR_NO_STD_INCLUDES
 
 // Hook to allow providing a custom assert() before including this file.
@@ -47,20 +49,151 @@
     #ifndef STR_NO_STD_INCLUDES
         #include <cstdlib>
     #endif // STR_NO_STD_INCLUDES
-    #define STR_MEM_ALLOC(count) static_cast<char *>(std::malloc(count))
-    #define STR_MEM_FREE(ptr)    std::free(ptr)
+    #define STR_MEM_ALLOC(count)        static_cast<char *>(std::malloc(count))
+    #define STR_MEM_REALLOC(ptr, count) static_cast<char *>(std::realloc(ptr, count))
+    #define STR_MEM_FREE(ptr)           std::free(ptr)
 #endif // STR_MEM_ALLOC
 
+// STR_MEM_REALLOC is optional when providing custom allocation funcs:
+// if it is not defined, growing falls back to alloc + copy + free.
+// Defining it lets allocators that can extend a block in place (e.g.
+// realloc under jemalloc) grow string buffers with zero copying.
+
+// Hook to allow customizing the geometric growth policy used by the
+// append-style operations (append/push_back/appendf/etc). Receives the
+// current capacity and must evaluate to the next capacity to try; the
+// result is clamped below by the exact number of chars needed, so a
+// too-small answer only costs extra reallocations, never correctness.
+// Default grows by 1.5x, which keeps amortized append O(1). Operations
+// that know the final size up front (set, setf, resize) still allocate
+// an exact fit and are not affected by this policy.
+#ifndef STR_GROWTH_FACTOR
+    #define STR_GROWTH_FACTOR(capacity) ((capacity) + ((capacity) / 2))
+#endif // STR_GROWTH_FACTOR
+
 #if defined(__GNUC__) || defined(__clang__)
     #define STR_FORMAT_FUNC(fmtIndex, varIndex) __attribute__((format(printf, fmtIndex, varIndex)))
 #else // !GNU && !Clang
     #define STR_FORMAT_FUNC(fmtIndex, varIndex) /* unimplemented for now */
 #endif // GNU || Clang
 
+// ========================================================
+// struct str_allocator:
+// ========================================================
+
+//
+// Optional runtime allocator hook. While an allocator is bound (per thread)
+// via str_set_allocator(), every str that outgrows its local buffer gets its
+// heap memory from the callbacks below instead of STR_MEM_ALLOC/STR_MEM_FREE.
+//
+// CAVEAT:
+// The bound allocator must outlive every string allocated from it, and the
+// same allocator should be bound when such strings are freed/destroyed.
+// Binding is per-thread, so each thread manages its own allocator.
+//
+struct str_allocator
+{
+    char * (*alloc_fn)(int size_in_bytes, void * user_data);
+    void   (*free_fn)(char * ptr, void * user_data);
+
+    // Optional - may be null, in which case growing a block
+    // falls back to alloc_fn + copy + free_fn.
+    char * (*realloc_fn)(char * ptr, int new_size_in_bytes, void * user_data);
+
+    void * user_data;
+};
+
+// Binds the given allocator to the calling thread and returns the previously
+// bound one (null if none). Pass nullptr to restore the STR_MEM_ALLOC default.
+str_allocator * str_set_allocator(str_allocator * allocator) noexcept;
+
+// The allocator currently bound to the calling thread (null if none).
+str_allocator * str_get_allocator() noexcept;
+
+// ========================================================
+// Allocation statistics (STR_ENABLE_STATS):
+// ========================================================
+
+// Define STR_ENABLE_STATS before including this file to compile in a
+// statistics layer behind the allocation hooks. Counters are plain
+// thread_local integers - no atomics, no contention - and the whole
+// layer compiles away when the macro is off. While enabled, every
+// string heap block carries an 8-byte size header so frees and
+// reallocs can subtract exactly what they release without any help
+// from the underlying allocator.
+//
+// The counters cover the string buffers themselves (including the
+// str_shared blocks); the auxiliary containers (str_arena, str_builder,
+// str_array, str_intern_table) allocate through STR_MEM_ALLOC directly
+// and are not included.
+#ifdef STR_ENABLE_STATS
+
+struct str_stats
+{
+    std::uint64_t alloc_calls;           // Allocations through the mem hooks.
+    std::uint64_t realloc_calls;         // Reallocations through the mem hooks.
+    std::uint64_t free_calls;            // Frees through the mem hooks.
+    std::uint64_t bytes_requested;       // Total bytes asked of alloc + realloc.
+    std::uint64_t live_bytes;            // Bytes currently allocated.
+    std::uint64_t peak_live_bytes;       // High-water mark of live_bytes.
+    std::uint64_t reserve_grows;         // Growths triggered by reserve().
+    std::uint64_t reserve_discard_grows; // Growths triggered by reserve_discard().
+    std::uint64_t local_buffer_grows;    // Growths served by the local buffer, i.e. SSO
+                                         // hits; the remainder went to the heap.
+};
+
+// Snapshot of the calling thread's counters (a cheap struct copy).
+str_stats str_get_stats() noexcept;
+
+// Zeroes the calling thread's counters. live_bytes (and the peak) are
+// re-based on the blocks still allocated instead of cleared, so frees
+// after the reset don't underflow.
+void str_reset_stats() noexcept;
+
+#endif // STR_ENABLE_STATS
+
 // ========================================================
 // class str:
 // ========================================================
 
+class str_ref; // Forward declaration for str::substr_ref().
+
+// Forward declaration for the operator + concatenation expressions.
+template<typename LhsT, typename RhsT>
+struct str_concat;
+
+// ========================================================
+// struct str_literal:
+// ========================================================
+
+//
+// Couples a string literal with its length, taken from the array bound
+// at compile time - so hot call sites that repeatedly test against a
+// fixed string never pay for a strlen:
+//
+//   static constexpr str_literal png_ext{ ".png" };
+//   if (name.ends_with(png_ext)) { ... }
+//
+// Only bind this to actual literals (or arrays that are full up to
+// their terminator); for a char array used as a buffer the bound would
+// overstate the length.
+//
+struct str_literal
+{
+    const char * ptr;
+    int          len;
+
+    template<int Size>
+    constexpr str_literal(const char (&literal)[Size]) noexcept
+        : ptr{ literal }
+        , len{ Size - 1 } // Not counting the null terminator.
+    {
+    }
+
+    constexpr const char * c_str()  const noexcept { return ptr; }
+    constexpr int          length() const noexcept { return len; }
+};
+
 class str
 {
 public:
@@ -77,6 +210,16 @@ public:
     str(const str & rhs, int count);
     str(const str & rhs, int first, int count);
 
+    // Materializes a concatenation expression built with the non-member
+    // operator + (one sized allocation, one memcpy per operand - see the
+    // str_concat section below).
+
+    template<typename LhsT, typename RhsT>
+    str(const str_concat<LhsT, RhsT> & expr);
+
+    template<typename LhsT, typename RhsT>
+    str & operator = (const str_concat<LhsT, RhsT> & expr);
+
     str(const char * rhs);
     str(const char * rhs, int count);
     str(const char * rhs, int first, int count);
@@ -86,6 +229,13 @@ public:
     str(const std::string & rhs, int first, int count);
 
     // Set/assign:
+    //
+    // The counted overloads (and everything layered on them - copies,
+    // appends, inserts) are length-driven end to end: an explicit count
+    // is honored across interior '\0' bytes, so binary payloads can
+    // live in a str alongside text. The buffer is still terminated at
+    // length() for c_str() interop; only the count-less C-string
+    // overloads scan for a terminator.
 
     void set(const str & src);
     void set(const str & src, int count);
@@ -99,16 +249,28 @@ public:
     void set(const std::string & src, int count);
     void set(const std::string & src, int first, int count);
 
+    void set(const str_literal & src); // Length known at compile time.
+
     // Keeps a non-owning reference to the external string:
 
     void set_ref(const str & src);
     void set_ref(const str & src, int first);
+    void set_ref(const str & src, int first, int count);
 
     void set_ref(const char * src);
     void set_ref(const char * src, int first);
+    void set_ref(const char * src, int first, int count);
 
     void set_ref(const std::string & src);
     void set_ref(const std::string & src, int first);
+    void set_ref(const std::string & src, int first, int count);
+
+    // Non-owning view of count chars starting at first. O(1): the
+    // caller-provided bounds are trusted, no strlen runs. NOTE: unless
+    // the slice ends exactly at this string's end, the view is not
+    // null-terminated at its reported length - treat it as data()/
+    // length() ranges, not as a C string.
+    str_ref substr_ref(int first, int count) const;
 
     // Append/push-pop:
 
@@ -124,6 +286,14 @@ public:
     void append(const std::string & src, int count);
     void append(const std::string & src, int first, int count);
 
+    void append(const str_literal & src); // Length known at compile time.
+
+    // Validates the input as UTF-8 while copying it, so hot ingestion
+    // paths do one pass over the bytes instead of append() followed by
+    // a separate validation scan. Appends nothing and returns false on
+    // malformed input (the string is left exactly as it was).
+    bool append_validated(const char * src, int count);
+
     void push_back(char c);
     void pop_back();
 
@@ -132,20 +302,52 @@ public:
     int compare(const str & rhs) const;
     int compare(const char * rhs) const;
     int compare(const std::string & rhs) const;
+    int compare(const str_literal & rhs) const;
 
     int compare_no_case(const str & rhs) const;
     int compare_no_case(const char * rhs) const;
     int compare_no_case(const std::string & rhs) const;
 
+    // Equality test that short-circuits on the stored lengths before
+    // looking at the characters. Prefer these over compare() == 0 when
+    // only equality matters - a length mismatch answers in O(1).
+    bool equals(const str & rhs) const;
+    bool equals(const char * rhs, int rhs_len) const;
+    bool equals(const std::string & rhs) const;
+    bool equals(const str_literal & rhs) const;
+
+    // 64-bit hash of the string contents (Murmur-style mixing over
+    // 8-byte blocks of m_data/m_length - no terminator scan). Also
+    // usable with std::hash and the transparent str_hash functor below.
+    std::uint64_t hash() const;
+    static std::uint64_t hash(const char * data, int len);
+
     bool starts_with(const str & prefix) const;
     bool starts_with(const char * prefix) const;
     bool starts_with(const char * prefix, int prefix_len) const;
     bool starts_with(const std::string & prefix) const;
+    bool starts_with(const str_literal & prefix) const;
 
     bool ends_with(const str & suffix) const;
     bool ends_with(const char * suffix) const;
     bool ends_with(const char * suffix, int suffix_len) const;
     bool ends_with(const std::string & suffix) const;
+    bool ends_with(const str_literal & suffix) const;
+
+    // Case-insensitive variants (ASCII folding). These compare in place
+    // using the stored lengths - no temporary lowercased copies.
+
+    bool starts_with_no_case(const str & prefix) const;
+    bool starts_with_no_case(const char * prefix) const;
+    bool starts_with_no_case(const char * prefix, int prefix_len) const;
+    bool starts_with_no_case(const std::string & prefix) const;
+
+    bool ends_with_no_case(const str & suffix) const;
+    bool ends_with_no_case(const char * suffix) const;
+    bool ends_with_no_case(const char * suffix, int suffix_len) const;
+    bool ends_with_no_case(const std::string & suffix) const;
+
+    int first_index_of_no_case(const char * substring) const;
 
     int first_index_of(char c) const;
     int last_index_of(char c) const;
@@ -161,11 +363,37 @@ public:
     str & trim_left();
     str & trim();
 
-    // Whole string to uppercase or lowercase, in place:
+    // Replace or remove every occurrence, in place:
+
+    str & replace_all(char from, char to);
+    str & replace_all(const char * from, const char * to);
+    str & remove_all(char c);
+
+    // Insert/erase a character range at an arbitrary position, in place.
+    // Both shift the tail with a single memmove; insert() does at most
+    // one (geometric) reallocation. 'src' must not point into this
+    // string's own buffer.
+
+    str & insert(int index, const char * src);
+    str & insert(int index, const char * src, int count);
+    str & insert(int index, const str & src);
+    str & insert(int index, const std::string & src);
+
+    str & erase(int first, int count);
+
+    // Whole string to uppercase or lowercase, in place. These use a
+    // branchless ASCII fast path over the stored length (vectorizes
+    // well); bytes outside 'a'-'z'/'A'-'Z' pass through untouched.
+    // The rare caller that needs locale-aware behavior should use the
+    // explicit _locale variants, which keep the old per-char
+    // std::toupper/std::tolower semantics.
 
     str & to_upper();
     str & to_lower();
 
+    str & to_upper_locale();
+    str & to_lower_locale();
+
     // Mutating operators:
 
     str & operator = (const str & rhs);
@@ -214,6 +442,53 @@ public:
     bool appendf(const char * fmt, ...) STR_FORMAT_FUNC(2, 3);
     bool appendfv(const char * fmt, va_list args) STR_FORMAT_FUNC(2, 0);
 
+    // Fast number formatting. These write digits straight into the string
+    // buffer after a single bounded reserve - no varargs, no format string
+    // parsing - and are considerably faster than setf/appendf for numbers.
+
+    str & append_int(long long value);
+    str & append_uint(unsigned long long value);
+    str & append_hex(unsigned long long value, bool uppercase = false);
+    str & append_float(double value, int decimal_digits = 6);
+
+    // Fixed-width field append for hand-rolled formats (timestamps, log
+    // line layouts): pads the decimal digits with 'fill' up to 'width',
+    // straight digit stores with no printf anywhere. A '0' fill pads
+    // between the sign and the digits like printf("%0*d"); any other
+    // fill pads in front of the sign like printf("%*d"). Values wider
+    // than 'width' are appended in full. A fixed layout composes from
+    // chained calls, e.g. an ISO-8601 timestamp:
+    //
+    //   s.append_padded(year, 4) += '-';
+    //   s.append_padded(month, 2) += '-';
+    //   s.append_padded(day, 2) += 'T';
+    //   ...
+    str & append_padded(long long value, int width, char fill = '0');
+
+    str & set_int(long long value);
+    str & set_uint(unsigned long long value);
+    str & set_hex(unsigned long long value, bool uppercase = false);
+    str & set_float(double value, int decimal_digits = 6);
+
+    // Fast number parsing - the inverse of the formatters above. Plain
+    // digit loops over the stored length: no locale, no errno, no
+    // terminator scan. The whole string must be a number (no surrounding
+    // whitespace); trailing garbage, empty input and integer overflow
+    // return false and leave 'out' untouched. The float parsers accept
+    // an optional fraction and e/E exponent; out-of-range magnitudes
+    // round to infinity/zero like strtod, and results can differ from
+    // strtod by 1 ulp in the last place.
+
+    bool to_int(long long & out) const;
+    bool to_uint(unsigned long long & out) const;
+    bool to_float(float & out) const;
+    bool to_double(double & out) const;
+
+    static bool to_int(const char * src, int len, long long & out);
+    static bool to_uint(const char * src, int len, unsigned long long & out);
+    static bool to_float(const char * src, int len, float & out);
+    static bool to_double(const char * src, int len, double & out);
+
     // Queries/accessors:
 
     int length()   const noexcept;
@@ -223,6 +498,14 @@ public:
     bool empty() const noexcept;
     bool valid() const noexcept;
 
+    // Encoding checks over the stored length. is_ascii() tests eight
+    // bytes per iteration against the high bits; validate_utf8() takes
+    // the same word-at-a-time fast path over ASCII runs and falls back
+    // to per-sequence checks (rejecting overlongs, surrogate halves
+    // and code points above U+10FFFF) only for multi-byte leads.
+    bool is_ascii() const noexcept;
+    bool validate_utf8() const noexcept;
+
     bool owns_buffer() const noexcept;
     bool using_local_buffer() const noexcept;
 
@@ -253,6 +536,7 @@ public:
     static int compare(const char * a, const char * b);
     static int compare(const char * a, const char * b, int chars_to_compare);
     static int compare_no_case(const char * a, const char * b);
+    static int compare_no_case(const char * a, const char * b, int chars_to_compare);
 
     static int copy(char * dest, int dest_size_in_chars, const char * source);
     static int copy(char * dest, int dest_size_in_chars, const char * source, int chars_to_copy);
@@ -263,6 +547,9 @@ public:
     static char * to_upper(char * str);
     static char * to_lower(char * str);
 
+    static bool is_ascii(const char * str, int len);
+    static bool validate_utf8(const char * str, int len);
+
     static char * split(char * str, const char * delimiters, char ** remaining);
     static int length(const char * str);
 
@@ -441,12 +728,38 @@ protected:
     char * get_local_buffer() const noexcept;
     char * get_empty_dummy_string() const noexcept;
 
+    // All dynamic memory goes through these; they dispatch to the
+    // thread-bound str_allocator if one is set, STR_MEM_ALLOC otherwise.
+    static char * mem_alloc(int size_in_bytes);
+    static char * mem_realloc(char * ptr, int bytes_to_preserve, int new_size_in_bytes);
+    static void mem_free(char * ptr);
+
+    // Geometric growth used by the append-style operations, so a long
+    // append loop reallocates O(log n) times instead of once per call.
+    int grow_capacity(int chars_needed) const noexcept;
+    void reserve_for_append(int chars_needed);
+
+    // m_capacity stores the allocated size directly only up to just under
+    // 2 MB. Bigger heap blocks set every capacity bit as a sentinel and
+    // carry their real size in an int32 header in front of the character
+    // data, which lifts the effective capacity limit to INT_MAX (lengths
+    // are a 32-bit int). All heap blocks flow through these helpers so
+    // the header is added, moved and freed consistently.
+    static const std::uint32_t big_capacity_sentinel  = (1u << 21) - 1;
+    static const int           big_capacity_header_size = static_cast<int>(sizeof(std::int32_t));
+
+    bool has_big_capacity() const noexcept { return m_capacity == big_capacity_sentinel; }
+
+    static char * heap_alloc_chars(int capacity_in_chars);
+    char * heap_realloc_chars(int bytes_to_preserve, int new_capacity) const;
+    void free_heap_buffer();
+
     // Constructor for str_sized<N> variants with a local buffer.
     explicit str(int local_buf_size);
 
     char *        m_data;                   // Pointer to an inline/local buffer or heap allocated memory.
     std::int32_t  m_length;                 // Current length in chars, not counting the null terminator.
-    std::uint32_t m_capacity          : 21; // Allocated capacity in chars. Max 2 MB.
+    std::uint32_t m_capacity          : 21; // Allocated capacity in chars; all bits set = spilled to a block header.
     std::uint32_t m_local_buffer_size : 10; // Size of inline/local storage (SSO), if using any. Max 1023 bytes.
     std::uint32_t m_owns_buffer       : 1;  // True if the data buffer is owned by the str and must be freed.
 };
@@ -492,8 +805,126 @@ public:
     str_sized & operator = (const std::string & rhs) { set(rhs); return *this; }
     str_sized & operator = (const char * rhs)        { set(rhs); return *this; }
 
+    // Concatenation expressions materialize through the str base so
+    // small results land straight in the local buffer:
+
+    template<typename LhsT, typename RhsT>
+    str_sized(const str_concat<LhsT, RhsT> & expr) : str{ Size } { str::operator = (expr); }
+
+    template<typename LhsT, typename RhsT>
+    str_sized & operator = (const str_concat<LhsT, RhsT> & expr) { str::operator = (expr); return *this; }
+
+    // Moves between two str_sized of the same Size either steal the heap
+    // block or memcpy just length+1 bytes of the local buffer - never a
+    // full set() copy like the generic str move path has to do.
+
+    str_sized(str_sized && rhs) noexcept : str{ Size }
+    {
+        move_from(rhs);
+    }
+
+    str_sized & operator = (str_sized && rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            clear(); // Release any heap block we own first.
+            move_from(rhs);
+        }
+        return *this;
+    }
+
+    // Member swap used by the swap() overload below. Swaps only the live
+    // bytes of the local buffers (lengths are known and small) and/or the
+    // heap pointers - no temporary str_sized copies involved.
+    void swap_with(str_sized & other) noexcept
+    {
+        const bool this_local  = using_local_buffer();
+        const bool other_local = other.using_local_buffer();
+
+        if (this_local && other_local)
+        {
+            const std::int32_t this_len  = m_length;
+            const std::int32_t other_len = other.m_length;
+
+            char temp[Size];
+            std::memcpy(temp, m_local_buf, this_len + 1);
+            std::memcpy(m_local_buf, other.m_local_buf, other_len + 1);
+            std::memcpy(other.m_local_buf, temp, this_len + 1);
+
+            m_length       = other_len;
+            other.m_length = this_len;
+        }
+        else if (!this_local && !other_local)
+        {
+            // Both heap allocated (or external refs) - plain field swap.
+            char * const        tmp_data     = m_data;
+            const std::int32_t  tmp_length   = m_length;
+            const std::uint32_t tmp_capacity = m_capacity;
+            const std::uint32_t tmp_owns     = m_owns_buffer;
+
+            m_data        = other.m_data;
+            m_length      = other.m_length;
+            m_capacity    = other.m_capacity;
+            m_owns_buffer = other.m_owns_buffer;
+
+            other.m_data        = tmp_data;
+            other.m_length      = tmp_length;
+            other.m_capacity    = tmp_capacity;
+            other.m_owns_buffer = tmp_owns;
+        }
+        else
+        {
+            // Mixed: hand the heap block to the local side and copy the
+            // local bytes into the (now free) local buffer of the other.
+            str_sized & local_side = (this_local ? *this : other);
+            str_sized & heap_side  = (this_local ? other : *this);
+
+            char * const        heap_data     = heap_side.m_data;
+            const std::int32_t  heap_length   = heap_side.m_length;
+            const std::uint32_t heap_capacity = heap_side.m_capacity;
+            const std::uint32_t heap_owns     = heap_side.m_owns_buffer;
+
+            std::memcpy(heap_side.m_local_buf, local_side.m_local_buf, local_side.m_length + 1);
+            heap_side.m_data        = heap_side.get_local_buffer();
+            heap_side.m_length      = local_side.m_length;
+            heap_side.m_capacity    = static_cast<std::uint32_t>(Size);
+            heap_side.m_owns_buffer = true;
+
+            local_side.m_data        = heap_data;
+            local_side.m_length      = heap_length;
+            local_side.m_capacity    = heap_capacity;
+            local_side.m_owns_buffer = heap_owns;
+        }
+    }
+
 private:
 
+    void move_from(str_sized & rhs) noexcept
+    {
+        if (rhs.using_local_buffer())
+        {
+            // Only length+1 bytes - the rest of the local buffer is noise.
+            std::memcpy(m_local_buf, rhs.m_local_buf, rhs.m_length + 1);
+            m_length = rhs.m_length; // m_data already points at our local buffer.
+            rhs.clear_no_free();
+        }
+        else
+        {
+            // Steal the heap block (or external reference) outright.
+            m_data        = rhs.m_data;
+            m_length      = rhs.m_length;
+            m_capacity    = rhs.m_capacity;
+            m_owns_buffer = rhs.m_owns_buffer;
+
+            // Reset rhs back to its own empty local buffer.
+            rhs.m_data        = rhs.get_local_buffer();
+            rhs.m_data[0]     = '\0';
+            rhs.m_length      = 0;
+            rhs.m_capacity    = static_cast<std::uint32_t>(Size);
+            rhs.m_owns_buffer = true;
+        }
+    }
+
     // Because str only reserves 10 bits for m_local_buffer_size, max length is 1023.
     static_assert(Size < 1024, "local buffer size is currently limited to 1023 characters!");
     static_assert(Size > 0,    "negative/zero size doesn't make sense!");
@@ -504,11 +935,11 @@ private:
 template<int Size>
 inline void swap(str_sized<Size> & lhs, str_sized<Size> & rhs) noexcept
 {
-    // Have to create the temporary since it is not safe to swap the
-    // m_data pointers referencing the inline buffer inside the objects.
-    str_sized<Size> tmp{ rhs };
-    rhs = lhs;
-    lhs = tmp;
+    // It is not safe to swap m_data pointers referencing the inline
+    // buffers inside the objects, but since both sizes are the same
+    // and known we can swap the buffer bytes directly - no deep
+    // temporary copies like the generic str swap would make.
+    lhs.swap_with(rhs);
 }
 
 //
@@ -535,1075 +966,4235 @@ public:
 
     str_ref(const str & rhs) { set_ref(rhs); }
     str_ref(const str & rhs, int first) { set_ref(rhs, first); }
+    str_ref(const str & rhs, int first, int count) { set_ref(rhs, first, count); }
 
     str_ref(const char * rhs) { set_ref(rhs); }
     str_ref(const char * rhs, int first) { set_ref(rhs, first); }
+    str_ref(const char * rhs, int first, int count) { set_ref(rhs, first, count); }
 
     str_ref(const std::string & rhs) { set_ref(rhs); }
     str_ref(const std::string & rhs, int first) { set_ref(rhs, first); }
+    str_ref(const std::string & rhs, int first, int count) { set_ref(rhs, first, count); }
 };
 
+// Defined here because it needs the complete str_ref type:
+inline str_ref str::substr_ref(const int first, const int count) const
+{
+    STR_ASSERT(first >= 0);
+    STR_ASSERT(count >= 0);
+    STR_ASSERT(first + count <= m_length);
+    return str_ref{ m_data, first, count };
+}
+
 // ========================================================
-// Inline methods of str:
+// class str_shared:
 // ========================================================
 
-inline str::str(str && rhs) noexcept
-    : str{}
+//
+// Reference-counted sharing for large immutable strings. Construction
+// copies the characters once into a heap block carrying an atomic
+// refcount in its header; copying a str_shared afterwards is a pointer
+// plus an increment, and the block is freed on the last release. The
+// base str holds the characters as a non-owning view, so operations
+// that grow the string (set/append/resize/...) reallocate into a
+// private buffer automatically and leave every other reference intact.
+//
+// Intended for fanning the same multi-KB payload out to many consumers
+// (worker threads, queued jobs) without one full copy per consumer.
+// The refcount is atomic, so references may be copied and destroyed
+// from different threads concurrently; the characters themselves are
+// only safe to share while nobody writes to them.
+//
+// CAVEAT:
+// In-place writes that don't grow the string (non-const operator[],
+// iterators, to_lower/trim and friends) would scribble over every
+// other reference's characters - call detach() first to force a
+// private copy before using any of those.
+//
+class str_shared final
+    : public str
 {
-    if (rhs.using_local_buffer())
+public:
+
+    str_shared() noexcept = default;
+
+    str_shared(const char * rhs) { share(rhs, length(rhs)); }
+    str_shared(const char * rhs, const int count) { share(rhs, count); }
+    str_shared(const str & rhs) { share(rhs.c_str(), rhs.length()); }
+    str_shared(const std::string & rhs) { share(rhs.c_str(), narrow<int>(rhs.length())); }
+
+    str_shared(const str_shared & rhs);
+    str_shared & operator = (const str_shared & rhs);
+
+    str_shared(str_shared && rhs) noexcept;
+    str_shared & operator = (str_shared && rhs) noexcept;
+
+    ~str_shared();
+
+    // Forces a private copy of the characters, so in-place writes no
+    // longer touch the shared block. No-op when already private.
+    void detach();
+
+    // True while this string still views the shared block, i.e. a copy
+    // of it would be O(1). False once a mutation detached it.
+    bool is_shared() const noexcept;
+
+    // Number of references still holding this block (zero once this
+    // string no longer views it). Note that a mutated copy only drops
+    // its reference when destroyed or reassigned, so the count can
+    // exceed the number of instances actually viewing the characters.
+    // Mainly for tests and metrics - under concurrent copying the
+    // value can be stale as soon as it returns.
+    int ref_count() const noexcept;
+
+private:
+
+    struct shared_block
     {
-        // If the storage is inline with the object then we can't move.
-        set(rhs);
-        rhs.clear_no_free();
-    }
-    else
+        std::atomic<int> refs;
+        std::int32_t     length;
+        // Character data follows the header, null-terminated.
+    };
+
+    static char * block_chars(shared_block * block) noexcept
     {
-        // This string is default initialized, so swapping
-        // will get the contents from rhs and then clear it.
-        swap(*this, rhs);
+        return reinterpret_cast<char *>(block + 1);
     }
-}
 
-inline str & str::operator = (str && rhs) noexcept
+    static shared_block * make_block(const char * chars, int len);
+    static void add_ref(shared_block * block) noexcept;
+    static void release(shared_block * block) noexcept;
+
+    void share(const char * chars, int len);
+    void adopt(shared_block * block);
+    bool viewing_block() const noexcept;
+
+    shared_block * m_block = nullptr;
+};
+
+// ========================================================
+// Concatenation expressions (operator +):
+// ========================================================
+
+//
+// Expression-template concatenation: 'a + b + c' builds a lightweight
+// tree of (pointer, length) views instead of allocating a temporary
+// string per '+'. Nothing happens until the expression is assigned or
+// converted to a str - the materializing assignment then sizes the
+// destination once and memcpys every operand straight into place, so
+// an N-way concatenation costs at most one allocation.
+//
+//   str path = dir + "/" + name + "." + extension; // One allocation.
+//
+// Works with str, str_ref, the str_sized aliases, C-string literals
+// and std::string.
+//
+// CAVEAT:
+// The expression only references its operands' buffers. Materialize it
+// before any operand dies or is mutated, and don't assign an expression
+// to a string that is itself an operand (the destination buffer is
+// resized before the operands are read).
+//
+
+// Leaf node - a (pointer, length) view of a single operand.
+struct str_concat_leaf
 {
-    if (rhs.using_local_buffer())
-    {
-        // If the storage is inline with the object then we can't move.
-        set(rhs);
-        rhs.clear_no_free();
-    }
-    else
+    const char * ptr;
+    int          len;
+
+    str_concat_leaf(const str & s) : ptr{ s.c_str() }, len{ s.length() } {}
+    str_concat_leaf(const char * s) : ptr{ s }, len{ str::length(s) } {}
+    str_concat_leaf(const std::string & s) : ptr{ s.c_str() }, len{ static_cast<int>(s.length()) } {}
+
+    int length() const noexcept { return len; }
+
+    char * copy_to(char * dest) const
     {
-        str temp{};
-        swap(*this, rhs);
-        swap(temp,  rhs);
+        std::memcpy(dest, ptr, len);
+        return dest + len;
     }
-    return *this;
-}
+};
 
-inline str::str(const str & rhs) : str{}
+// Interior node - a pair of sub-expressions (leaves or other nodes),
+// held by value. The whole tree lives on the stack.
+template<typename LhsT, typename RhsT>
+struct str_concat
 {
-    set(rhs);
-}
+    LhsT lhs;
+    RhsT rhs;
 
-inline str::str(const str & rhs, int count) : str{}
-{
-    set(rhs, count);
-}
+    int length() const noexcept { return lhs.length() + rhs.length(); }
 
-inline str::str(const str & rhs, int first, int count) : str{}
-{
-    set(rhs, first, count);
-}
+    char * copy_to(char * dest) const
+    {
+        return rhs.copy_to(lhs.copy_to(dest));
+    }
+};
 
-inline str::str(const char * rhs) : str{}
-{
-    set(rhs);
-}
+// Roots: any two operands a leaf can view. The (str, str) overload also
+// covers str_ref and the str_sized aliases through the base class.
 
-inline str::str(const char * rhs, int count) : str{}
+inline str_concat<str_concat_leaf, str_concat_leaf> operator + (const str & lhs, const str & rhs)
 {
-    set(rhs, count);
+    return { str_concat_leaf{ lhs }, str_concat_leaf{ rhs } };
 }
 
-inline str::str(const char * rhs, int first, int count) : str{}
+inline str_concat<str_concat_leaf, str_concat_leaf> operator + (const str & lhs, const char * rhs)
 {
-    set(rhs, first, count);
+    return { str_concat_leaf{ lhs }, str_concat_leaf{ rhs } };
 }
 
-inline str::str(const std::string & rhs) : str{}
+inline str_concat<str_concat_leaf, str_concat_leaf> operator + (const char * lhs, const str & rhs)
 {
-    set(rhs);
+    return { str_concat_leaf{ lhs }, str_concat_leaf{ rhs } };
 }
 
-inline str::str(const std::string & rhs, int count) : str{}
+inline str_concat<str_concat_leaf, str_concat_leaf> operator + (const str & lhs, const std::string & rhs)
 {
-    set(rhs, count);
+    return { str_concat_leaf{ lhs }, str_concat_leaf{ rhs } };
 }
 
-inline str::str(const std::string & rhs, int first, int count) : str{}
+inline str_concat<str_concat_leaf, str_concat_leaf> operator + (const std::string & lhs, const str & rhs)
 {
-    set(rhs, first, count);
+    return { str_concat_leaf{ lhs }, str_concat_leaf{ rhs } };
 }
 
-inline str & str::operator = (const str & rhs)
-{
-    set(rhs);
-    return *this;
-}
+// Chaining: an existing expression plus one more operand.
 
-inline str & str::operator = (const char * rhs)
+template<typename LhsT, typename RhsT>
+inline str_concat<str_concat<LhsT, RhsT>, str_concat_leaf> operator + (const str_concat<LhsT, RhsT> & lhs, const str & rhs)
 {
-    set(rhs);
-    return *this;
+    return { lhs, str_concat_leaf{ rhs } };
 }
 
-inline str & str::operator = (const std::string & rhs)
+template<typename LhsT, typename RhsT>
+inline str_concat<str_concat<LhsT, RhsT>, str_concat_leaf> operator + (const str_concat<LhsT, RhsT> & lhs, const char * rhs)
 {
-    set(rhs);
-    return *this;
+    return { lhs, str_concat_leaf{ rhs } };
 }
 
-inline str & str::operator += (const char c)
+template<typename LhsT, typename RhsT>
+inline str_concat<str_concat<LhsT, RhsT>, str_concat_leaf> operator + (const str_concat<LhsT, RhsT> & lhs, const std::string & rhs)
 {
-    push_back(c);
-    return *this;
+    return { lhs, str_concat_leaf{ rhs } };
 }
 
-inline str & str::operator += (const str & rhs)
-{
-    append(rhs);
-    return *this;
-}
+// The materializing assignment - declared inside class str:
 
-inline str & str::operator += (const char * rhs)
+template<typename LhsT, typename RhsT>
+inline str & str::operator = (const str_concat<LhsT, RhsT> & expr)
 {
-    append(rhs);
-    return *this;
-}
+    const int total = expr.length();
 
-inline str & str::operator += (const std::string & rhs)
-{
-    append(rhs);
+    clear_no_free(); // reserve_discard() keeps the old contents if the capacity already fits.
+    reserve_discard(total + 1, 0);
+
+    char * end_ptr = expr.copy_to(m_data);
+    *end_ptr = '\0';
+
+    m_length      = total;
+    m_owns_buffer = true;
     return *this;
 }
 
-inline char & str::operator[](const int index)
+template<typename LhsT, typename RhsT>
+inline str::str(const str_concat<LhsT, RhsT> & expr) : str{}
 {
-    STR_ASSERT(valid());
-    STR_ASSERT(index >= 0);
-    STR_ASSERT(index < length());
-    return m_data[index];
+    *this = expr;
 }
 
-inline char str::operator[](const int index) const
-{
-    STR_ASSERT(valid());
-    STR_ASSERT(index >= 0);
-    STR_ASSERT(index < length());
-    return m_data[index];
-}
+// ========================================================
+// Hashing support:
+// ========================================================
 
-inline bool str::operator == (const str & rhs) const
+//
+// Transparent hash/equality functors for associative containers keyed
+// by str. The const char* and length-aware overloads let lookups run
+// without constructing a temporary str (heterogeneous lookup with
+// containers that support is_transparent). str_ref and str_sized keys
+// go through the const str& overloads.
+//
+struct str_hash
 {
-    return str::compare(c_str(), rhs.c_str()) == 0;
-}
+    using is_transparent = void;
 
-inline bool str::operator != (const str & rhs) const
-{
-    return str::compare(c_str(), rhs.c_str()) != 0;
-}
+    std::size_t operator()(const str & s) const
+    {
+        return static_cast<std::size_t>(s.hash());
+    }
+    std::size_t operator()(const char * s) const
+    {
+        return static_cast<std::size_t>(str::hash(s, str::length(s)));
+    }
+};
 
-inline bool str::operator <= (const str & rhs) const
+struct str_equal_to
 {
-    return str::compare(c_str(), rhs.c_str()) <= 0;
-}
+    using is_transparent = void;
+
+    bool operator()(const str & a, const str & b) const
+    {
+        return a.equals(b);
+    }
+    bool operator()(const str & a, const char * b) const
+    {
+        return a.equals(b, str::length(b));
+    }
+    bool operator()(const char * a, const str & b) const
+    {
+        return b.equals(a, str::length(a));
+    }
+};
+
+// std::hash specializations so str types work as unordered container
+// keys out of the box:
+namespace std
+{
+template<>
+struct hash<str>
+{
+    size_t operator()(const str & s) const
+    {
+        return static_cast<size_t>(s.hash());
+    }
+};
+
+template<>
+struct hash<str_ref>
+{
+    size_t operator()(const str_ref & s) const
+    {
+        return static_cast<size_t>(s.hash());
+    }
+};
+
+template<int Size>
+struct hash<str_sized<Size>>
+{
+    size_t operator()(const str_sized<Size> & s) const
+    {
+        return static_cast<size_t>(s.hash());
+    }
+};
+} // namespace std {}
+
+// ========================================================
+// class str_tokenizer:
+// ========================================================
+
+//
+// Read-only tokenizer that yields non-owning str_ref slices over a
+// const source buffer. Unlike the strtok-style str::split(), it never
+// writes null bytes into the input, builds a 256-bit delimiter bitmap
+// once up front (one bit test per char instead of a nested delimiter
+// scan), and makes one pass over the source with zero allocations.
+//
+// Supports both a pull interface and range-for:
+//
+//   str_tokenizer tokenizer{ line, ",;" };
+//   for (const str_ref token : tokenizer) { ... }
+//
+// Tokens that do not end at the source terminator are not
+// null-terminated - use them as data()/length() ranges.
+//
+class str_tokenizer final
+{
+public:
+
+    str_tokenizer(const str & source, const char * delimiters);
+    str_tokenizer(const char * source, int source_len, const char * delimiters);
+
+    // Pull interface - returns false once the source is exhausted.
+    bool next_token(str_ref & out_token);
+
+    // Rewind to the start of the source.
+    void reset() noexcept { m_pos = 0; }
+
+    //
+    // Minimal single-pass forward iterator for range-for support.
+    //
+    class iterator final
+    {
+    public:
+        explicit iterator(str_tokenizer * tokenizer) // end() iterator when null
+            : m_tokenizer{ tokenizer }
+            , m_token{ "" }
+            , m_done{ true }
+        {
+            if (m_tokenizer != nullptr)
+            {
+                m_done = !m_tokenizer->next_token(m_token);
+            }
+        }
+
+        // Shallow copies are fine - the iterator only observes the
+        // tokenizer it points at. Spelled out for -Weffc++.
+        iterator(const iterator &) = default;
+        iterator & operator = (const iterator &) = default;
+
+        str_ref operator*() const { return m_token; }
+
+        iterator & operator++()
+        {
+            STR_ASSERT(m_tokenizer != nullptr);
+            m_done = !m_tokenizer->next_token(m_token);
+            return *this;
+        }
+
+        bool operator == (const iterator & other) const { return m_done == other.m_done; }
+        bool operator != (const iterator & other) const { return m_done != other.m_done; }
+
+    private:
+        str_tokenizer * m_tokenizer;
+        str_ref         m_token;
+        bool            m_done;
+    };
+
+    iterator begin() { reset(); return iterator{ this }; }
+    iterator end()   { return iterator{ nullptr }; }
+
+private:
+
+    void build_delimiter_bitmap(const char * delimiters);
+
+    bool is_delimiter(const char c) const noexcept
+    {
+        const unsigned char u = static_cast<unsigned char>(c);
+        return ((m_delim_bits[u >> 5] >> (u & 31)) & 1) != 0;
+    }
+
+    const char *  m_source;
+    int           m_source_len;
+    int           m_pos;
+    std::uint32_t m_delim_bits[8]; // 256-bit delimiter membership bitmap.
+};
+
+// ========================================================
+// class str_line_reader:
+// ========================================================
+
+//
+// Splits text into lines without copying: next_line() yields non-owning
+// str_ref slices over a caller-owned buffer, locating each newline with
+// a single memchr(). An optional '\r' before the '\n' is stripped, so
+// Unix and Windows line endings both work. The terminators themselves
+// are never included in the yielded lines.
+//
+// Streaming input that arrives in chunks is supported via refill(): a
+// line cut off at the end of one chunk is saved in a small internal
+// string and handed out stitched together once the rest arrives; lines
+// fully inside a chunk are always zero-copy slices of the caller's
+// buffer. Pass last_chunk = false while more input is coming - the
+// trailing partial line is then withheld until the next refill()
+// instead of being yielded early.
+//
+//   str_line_reader reader{ file_contents };
+//   str_ref line;
+//   while (reader.next_line(line)) { ... }
+//
+// Yielded slices are not null-terminated (use data()/length()) and a
+// stitched line only stays valid until the next call into the reader.
+//
+class str_line_reader final
+{
+public:
+
+    str_line_reader(const char * buffer, int buffer_len, bool last_chunk = true);
+    explicit str_line_reader(const str & buffer);
+
+    // Non-copyable - duplicating a reader mid-stream isn't meaningful.
+    str_line_reader(const str_line_reader &) = delete;
+    str_line_reader & operator = (const str_line_reader &) = delete;
+
+    // Pull interface - returns false once the buffer is exhausted
+    // (or once only a withheld partial line remains; see refill()).
+    bool next_line(str_ref & out_line);
+
+    // Hands the reader the next chunk of input. The current buffer must
+    // be exhausted. Any partial line carried from it is completed from
+    // the new chunk and yielded by the following next_line() call.
+    void refill(const char * buffer, int buffer_len, bool last_chunk = true);
+
+    // True if an unterminated line is being carried across refills.
+    bool has_partial_line() const noexcept { return !m_carry.empty() && !m_carry_yielded; }
+
+private:
+
+    const char * m_buffer;
+    int          m_buffer_len;
+    int          m_pos;
+    bool         m_last_chunk;
+    bool         m_carry_yielded; // Last yielded line lives in m_carry.
+    str          m_carry;         // Partial line carried across refills.
+};
+
+// ========================================================
+// class str_arena:
+// ========================================================
+
+//
+// Simple bump allocator backed by a chain of fixed-size blocks.
+// Individual frees are no-ops; release_all() returns every block's
+// memory in one shot, so tearing down thousands of temporary strings
+// costs O(number of blocks) instead of one free per string.
+//
+// Typical per-request usage:
+//
+//   str_arena arena;
+//   str_allocator * prev = str_set_allocator(arena.allocator());
+//   ... build temporary strings ...
+//   str_set_allocator(prev);
+//   arena.release_all(); // after the temporaries are done with
+//
+class str_arena final
+{
+public:
+
+    explicit str_arena(int block_size = 64 * 1024);
+    ~str_arena();
+
+    // Non-copyable (owns raw memory blocks).
+    str_arena(const str_arena &) = delete;
+    str_arena & operator = (const str_arena &) = delete;
+
+    // Bump-allocates from the current block, chaining a new
+    // block when full. Never returns null (asserts on OOM).
+    char * allocate(int size_in_bytes);
+
+    // Frees all blocks at once. Strings still pointing into the
+    // arena must not be used afterwards.
+    void release_all();
+
+    // Adapter suitable for str_set_allocator(). Frees are no-ops.
+    str_allocator * allocator() noexcept { return &m_allocator; }
+
+    // Total bytes currently held by the arena blocks (for stats/tuning).
+    int allocated_bytes() const noexcept { return m_total_bytes; }
+
+private:
+
+    struct block
+    {
+        block * next;
+        int     used;
+        int     size;
+        // Payload memory follows the header.
+    };
+
+    block * push_new_block(int min_payload_size);
+
+    static char * alloc_callback(int size_in_bytes, void * user_data);
+    static void free_callback(char * ptr, void * user_data);
+
+    block *       m_block_list;
+    int           m_block_size;
+    int           m_total_bytes;
+    str_allocator m_allocator;
+};
+
+// ========================================================
+// class str_intern_table:
+// ========================================================
+
+// Define STR_INTERN_THREAD_SAFE before including this file to make
+// str_intern_table safe for concurrent intern() calls. Inserts are then
+// guarded by sharded locks (one mutex per shard, shard picked from the
+// hash), so parser threads feeding the table mostly don't contend.
+// Pulls in <mutex> when enabled.
+#ifdef STR_INTERN_THREAD_SAFE
+    #ifndef STR_NO_STD_INCLUDES
+        #include <mutex>
+    #endif // STR_NO_STD_INCLUDES
+#endif // STR_INTERN_THREAD_SAFE
+
+//
+// Deduplicating string table. Each unique string is stored exactly once
+// (null-terminated, in an arena that is freed all at once on destruction)
+// and intern() returns a stable pointer that is identical for equal
+// contents - so interned strings compare with a pointer test instead of
+// a character compare. Intended for identifier-heavy workloads where the
+// same few hundred strings are parsed millions of times.
+//
+// Interned pointers remain valid until the table is destroyed.
+//
+class str_intern_table final
+{
+public:
+
+    str_intern_table() = default;
+    ~str_intern_table();
+
+    // Non-copyable (owns the arena and the hash entries).
+    str_intern_table(const str_intern_table &) = delete;
+    str_intern_table & operator = (const str_intern_table &) = delete;
+
+    // Returns the canonical pointer for the given string contents,
+    // inserting it on first sight. Equal contents => equal pointer.
+    const char * intern(const char * s);
+    const char * intern(const char * s, int len);
+    const char * intern(const str & s);
+
+    // Number of unique strings interned so far.
+    int size() const noexcept;
+
+private:
+
+    struct entry
+    {
+        std::uint64_t hash;
+        const char *  ptr; // Null when the slot is empty.
+        int           len;
+    };
+
+    struct shard
+    {
+        entry *   entries;
+        int       bucket_count; // Always zero or a power of two.
+        int       used;
+        str_arena arena;
+#ifdef STR_INTERN_THREAD_SAFE
+        std::mutex lock;
+#endif // STR_INTERN_THREAD_SAFE
+
+        // Non-copyable, like the arena it owns.
+        shard(const shard &) = delete;
+        shard & operator = (const shard &) = delete;
+
+        shard()
+            : entries{ nullptr }
+            , bucket_count{ 0 }
+            , used{ 0 }
+            , arena{}
+#ifdef STR_INTERN_THREAD_SAFE
+            , lock{}
+#endif // STR_INTERN_THREAD_SAFE
+        {
+        }
+    };
+
+#ifdef STR_INTERN_THREAD_SAFE
+    static const int shard_count = 8;
+#else // !STR_INTERN_THREAD_SAFE
+    static const int shard_count = 1;
+#endif // STR_INTERN_THREAD_SAFE
+
+    const char * intern_in_shard(shard & s, std::uint64_t hash, const char * str_data, int len);
+    static void grow_shard(shard & s);
+
+    shard m_shards[shard_count];
+};
+
+// ========================================================
+// class str_builder:
+// ========================================================
+
+//
+// Records a list of string fragments without copying the large ones,
+// then materializes everything into a str with exactly one allocation
+// (reserve_discard of the precomputed total) and one pass of memcpys.
+// Use this instead of chained += / append when composing a string from
+// many pieces - it avoids the reserve/grow cycle per fragment.
+//
+// CAVEAT:
+// Fragments added from str/str_ref/std::string/C string are referenced,
+// not copied, so the sources must stay alive and unchanged until
+// to_string() is called. Chars and formatted numbers are stored inside
+// the builder and have no lifetime requirements.
+//
+class str_builder final
+{
+public:
+
+    str_builder() noexcept;
+    ~str_builder();
+
+    // Non-copyable (fragments reference external memory).
+    str_builder(const str_builder &) = delete;
+    str_builder & operator = (const str_builder &) = delete;
+
+    // Record fragments (no copy for the string-like overloads):
+
+    str_builder & append(const str & src);
+    str_builder & append(const char * src);
+    str_builder & append(const char * src, int count);
+    str_builder & append(const std::string & src);
+    str_builder & append(char c);
+
+    // Numbers are formatted into internal storage at record time:
+
+    str_builder & append_int(long long value);
+    str_builder & append_uint(unsigned long long value);
+    str_builder & append_float(double value, int decimal_digits = 6);
+
+    // Sum of all recorded fragment lengths.
+    int total_length() const noexcept { return m_total_length; }
+    int fragment_count() const noexcept { return m_frag_count; }
+
+    // One reserve_discard + one copy pass into dest.
+    void to_string(str & dest) const;
+
+    // Drops all recorded fragments (keeps the fragment array memory).
+    void reset() noexcept;
+
+private:
+
+    struct fragment
+    {
+        const char * ptr;
+        int          len;
+    };
+
+    // Small stable-address pool for chars and formatted numbers.
+    struct scratch_block
+    {
+        scratch_block * next;
+        int             used;
+        char            data[240];
+    };
+
+    void push_fragment(const char * ptr, int len);
+    char * scratch_alloc(int size_in_bytes);
+
+    static const int local_fragment_count = 32;
+
+    fragment *      m_frags;
+    int             m_frag_count;
+    int             m_frag_capacity;
+    int             m_total_length;
+    scratch_block * m_scratch_list;
+    fragment        m_local_frags[local_fragment_count];
+};
+
+// ========================================================
+// class str_array:
+// ========================================================
+
+//
+// Append-only array of strings packed into a single contiguous char
+// block with an offset index - one allocation covers thousands of
+// entries regardless of their individual lengths, unlike an array of
+// str_sized where every slot pays for the worst-case local buffer.
+// Iteration touches memory linearly, which keeps scans cache-friendly.
+//
+// Entries are handed out as non-owning str_ref views; each stored
+// string is null-terminated inside the block, so the views are proper
+// C strings. Views are invalidated by push_back/shrink_to_fit/clear,
+// the same way std::vector iterators are.
+//
+class str_array final
+{
+public:
+
+    str_array() noexcept;
+    ~str_array();
+
+    // Non-copyable (owns raw memory blocks).
+    str_array(const str_array &) = delete;
+    str_array & operator = (const str_array &) = delete;
+
+    // Append-only building:
+
+    void push_back(const str & s);
+    void push_back(const char * s);
+    void push_back(const char * s, int len);
+    void push_back(const std::string & s);
+
+    // Queries/accessors:
+
+    int size() const noexcept { return m_count; }
+    bool empty() const noexcept { return m_count == 0; }
+
+    // Total chars stored (terminators included) and block capacity:
+    int character_bytes() const noexcept { return m_chars_used; }
+    int character_capacity() const noexcept { return m_chars_capacity; }
+
+    str_ref operator[](int index) const;
+
+    // Memory management:
+
+    void clear() noexcept;  // Drops all entries, keeps the blocks.
+    void shrink_to_fit();   // Trims both blocks to exact fit.
+
+    //
+    // Minimal forward iterator yielding str_ref views, for range-for.
+    //
+    class const_iterator final
+    {
+    public:
+        const_iterator(const str_array * array, const int index)
+            : m_array{ array }
+            , m_index{ index }
+        { }
+
+        str_ref operator*() const { return (*m_array)[m_index]; }
+
+        const_iterator & operator++() { ++m_index; return *this; }
+
+        bool operator == (const const_iterator & other) const { return m_index == other.m_index; }
+        bool operator != (const const_iterator & other) const { return m_index != other.m_index; }
+
+    private:
+        const str_array * m_array;
+        int               m_index;
+    };
+
+    const_iterator begin() const { return const_iterator{ this, 0 }; }
+    const_iterator end()   const { return const_iterator{ this, m_count }; }
+
+private:
+
+    void grow_chars(int chars_needed);
+    void grow_offsets();
+
+    char * m_chars;          // All character data, entries null-terminated back to back.
+    int    m_chars_used;
+    int    m_chars_capacity;
+
+    int *  m_offsets;        // m_count+1 entries; [i] is the start of string i,
+    int    m_count;          // [m_count] is m_chars_used, so lengths need no table.
+    int    m_offsets_capacity;
+};
+
+// ========================================================
+// namespace str_bulk:
+// ========================================================
+
+// Needs std::thread for the worker fan-out.
+#ifndef STR_NO_STD_INCLUDES
+    #include <thread>
+#endif // STR_NO_STD_INCLUDES
+
+//
+// Bulk operations over contiguous arrays of str, partitioned across a
+// caller-supplied thread count. Each worker gets one contiguous shard
+// of the array - so workers touch disjoint memory except at the shard
+// boundaries - and runs the regular single-string member functions
+// over it. A thread_count of 1 (the default) does everything on the
+// calling thread without ever constructing a std::thread.
+//
+// The named operations below mutate in place and never allocate, so
+// it doesn't matter that the workers have no thread-bound
+// str_allocator. Custom kernels run through for_each() that change
+// string lengths should keep that in mind.
+//
+namespace str_bulk
+{
+
+const int max_thread_count = 64; // Larger requests are clamped.
+
+// Splits [begin, end) into up to thread_count contiguous shards and
+// invokes fn(shard_begin, shard_end, shard_index) on each, the last
+// one on the calling thread itself. Building block for the named
+// operations; usable directly for custom sharded kernels.
+template<typename T, typename Fn>
+void parallel_shards(T * begin, T * end, int thread_count, const Fn & fn)
+{
+    const int total = static_cast<int>(end - begin);
+    STR_ASSERT(total >= 0);
+
+    if (thread_count > total)
+    {
+        thread_count = total;
+    }
+    if (thread_count > max_thread_count)
+    {
+        thread_count = max_thread_count;
+    }
+    if (thread_count <= 1)
+    {
+        if (total > 0)
+        {
+            fn(begin, end, 0);
+        }
+        return;
+    }
+
+    const int per_shard = total / thread_count;
+    const int remainder = total % thread_count;
+
+    std::thread workers[max_thread_count - 1];
+    int worker_count = 0;
+
+    T * shard_begin = begin;
+    for (int i = 0; i < thread_count; ++i)
+    {
+        // The first 'remainder' shards take one extra entry.
+        T * shard_end = shard_begin + per_shard + (i < remainder ? 1 : 0);
+        if (i != thread_count - 1)
+        {
+            workers[worker_count++] = std::thread{ [=]() { fn(shard_begin, shard_end, i); } };
+        }
+        else
+        {
+            fn(shard_begin, shard_end, i);
+        }
+        shard_begin = shard_end;
+    }
+
+    for (int i = 0; i < worker_count; ++i)
+    {
+        workers[i].join();
+    }
+}
+
+// Runs fn(str &) over every string in [begin, end), sharded as above.
+template<typename Fn>
+void for_each(str * begin, str * end, const int thread_count, const Fn & fn)
+{
+    parallel_shards(begin, end, thread_count,
+                    [fn](str * first, str * last, int /* shard_index */)
+    {
+        for (str * s = first; s != last; ++s)
+        {
+            fn(*s);
+        }
+    });
+}
+
+void to_lower(str * begin, str * end, int thread_count = 1);
+void to_upper(str * begin, str * end, int thread_count = 1);
+void trim(str * begin, str * end, int thread_count = 1);
+
+// Index into [begin, end) of the first string that contains
+// 'substring', or -1 when none does.
+int find_first(const str * begin, const str * end, const char * substring, int thread_count = 1);
+
+} // namespace str_bulk {}
+
+// ========================================================
+// Inline methods of str:
+// ========================================================
+
+inline str::str(str && rhs) noexcept
+    : str{}
+{
+    if (rhs.using_local_buffer())
+    {
+        // If the storage is inline with the object then we can't move.
+        set(rhs);
+        rhs.clear_no_free();
+    }
+    else
+    {
+        // This string is default initialized, so swapping
+        // will get the contents from rhs and then clear it.
+        swap(*this, rhs);
+    }
+}
+
+inline str & str::operator = (str && rhs) noexcept
+{
+    if (rhs.using_local_buffer())
+    {
+        // If the storage is inline with the object then we can't move.
+        set(rhs);
+        rhs.clear_no_free();
+    }
+    else
+    {
+        str temp{};
+        swap(*this, rhs);
+        swap(temp,  rhs);
+    }
+    return *this;
+}
+
+inline str::str(const str & rhs) : str{}
+{
+    set(rhs);
+}
+
+inline str::str(const str & rhs, int count) : str{}
+{
+    set(rhs, count);
+}
+
+inline str::str(const str & rhs, int first, int count) : str{}
+{
+    set(rhs, first, count);
+}
+
+inline str::str(const char * rhs) : str{}
+{
+    set(rhs);
+}
+
+inline str::str(const char * rhs, int count) : str{}
+{
+    set(rhs, count);
+}
+
+inline str::str(const char * rhs, int first, int count) : str{}
+{
+    set(rhs, first, count);
+}
+
+inline str::str(const std::string & rhs) : str{}
+{
+    set(rhs);
+}
+
+inline str::str(const std::string & rhs, int count) : str{}
+{
+    set(rhs, count);
+}
+
+inline str::str(const std::string & rhs, int first, int count) : str{}
+{
+    set(rhs, first, count);
+}
+
+inline str & str::operator = (const str & rhs)
+{
+    set(rhs);
+    return *this;
+}
+
+inline str & str::operator = (const char * rhs)
+{
+    set(rhs);
+    return *this;
+}
+
+inline str & str::operator = (const std::string & rhs)
+{
+    set(rhs);
+    return *this;
+}
+
+inline str & str::operator += (const char c)
+{
+    push_back(c);
+    return *this;
+}
+
+inline str & str::operator += (const str & rhs)
+{
+    append(rhs);
+    return *this;
+}
+
+inline str & str::operator += (const char * rhs)
+{
+    append(rhs);
+    return *this;
+}
+
+inline str & str::operator += (const std::string & rhs)
+{
+    append(rhs);
+    return *this;
+}
+
+inline char & str::operator[](const int index)
+{
+    STR_ASSERT(valid());
+    STR_ASSERT(index >= 0);
+    STR_ASSERT(index < length());
+    return m_data[index];
+}
+
+inline char str::operator[](const int index) const
+{
+    STR_ASSERT(valid());
+    STR_ASSERT(index >= 0);
+    STR_ASSERT(index < length());
+    return m_data[index];
+}
+
+inline bool str::equals(const str & rhs) const
+{
+    return equals(rhs.c_str(), rhs.length());
+}
+
+inline bool str::equals(const char * rhs, const int rhs_len) const
+{
+    STR_ASSERT(rhs != nullptr);
+    STR_ASSERT(rhs_len >= 0);
+
+    if (m_length != rhs_len)
+    {
+        return false;
+    }
+    return std::memcmp(m_data, rhs, m_length) == 0;
+}
+
+inline bool str::equals(const std::string & rhs) const
+{
+    return equals(rhs.c_str(), narrow<int>(rhs.length()));
+}
+
+inline std::uint64_t str::hash() const
+{
+    return str::hash(m_data, m_length);
+}
+
+inline bool str::operator == (const str & rhs) const
+{
+    // Both sides carry their length, so a mismatch answers
+    // without touching either character buffer.
+    return equals(rhs);
+}
+
+inline bool str::operator != (const str & rhs) const
+{
+    return !equals(rhs);
+}
+
+inline bool str::operator <= (const str & rhs) const
+{
+    return str::compare(c_str(), rhs.c_str()) <= 0;
+}
 
 inline bool str::operator >= (const str & rhs) const
 {
-    return str::compare(c_str(), rhs.c_str()) >= 0;
+    return str::compare(c_str(), rhs.c_str()) >= 0;
+}
+
+inline bool str::operator > (const str & rhs) const
+{
+    return str::compare(c_str(), rhs.c_str()) > 0;
+}
+
+inline bool str::operator < (const str & rhs) const
+{
+    return str::compare(c_str(), rhs.c_str()) < 0;
+}
+
+inline bool str::operator == (const char * rhs) const
+{
+    return str::compare(c_str(), rhs) == 0;
+}
+
+inline bool str::operator != (const char * rhs) const
+{
+    return str::compare(c_str(), rhs) != 0;
+}
+
+inline bool str::operator <= (const char * rhs) const
+{
+    return str::compare(c_str(), rhs) <= 0;
+}
+
+inline bool str::operator >= (const char * rhs) const
+{
+    return str::compare(c_str(), rhs) >= 0;
+}
+
+inline bool str::operator > (const char * rhs) const
+{
+    return str::compare(c_str(), rhs) > 0;
+}
+
+inline bool str::operator < (const char * rhs) const
+{
+    return str::compare(c_str(), rhs) < 0;
+}
+
+inline bool str::operator == (const std::string & rhs) const
+{
+    return equals(rhs);
+}
+
+inline bool str::operator != (const std::string & rhs) const
+{
+    return !equals(rhs);
+}
+
+inline bool str::operator <= (const std::string & rhs) const
+{
+    return str::compare(c_str(), rhs.c_str()) <= 0;
+}
+
+inline bool str::operator >= (const std::string & rhs) const
+{
+    return str::compare(c_str(), rhs.c_str()) >= 0;
+}
+
+inline bool str::operator > (const std::string & rhs) const
+{
+    return str::compare(c_str(), rhs.c_str()) > 0;
+}
+
+inline bool str::operator < (const std::string & rhs) const
+{
+    return str::compare(c_str(), rhs.c_str()) < 0;
+}
+
+inline void str::set(const str & src)
+{
+    set(src.c_str(), 0, src.length());
+}
+
+inline void str::set(const str & src, int count)
+{
+    set(src.c_str(), 0, count);
+}
+
+inline void str::set(const str & src, int first, int count)
+{
+    set(src.c_str(), first, count);
+}
+
+inline void str::set(const char * src)
+{
+    set(src, 0, str::length(src));
+}
+
+inline void str::set(const char * src, int count)
+{
+    set(src, 0, count);
+}
+
+inline void str::set(const std::string & src)
+{
+    set(src.c_str(), 0, narrow<int>(src.length()));
+}
+
+inline void str::set(const std::string & src, int count)
+{
+    set(src.c_str(), 0, count);
+}
+
+inline void str::set(const std::string & src, int first, int count)
+{
+    set(src.c_str(), first, count);
+}
+
+inline void str::set_ref(const str & src)
+{
+    set_ref(src.c_str(), 0);
+}
+
+inline void str::set_ref(const str & src, const int first)
+{
+    STR_ASSERT(first < src.length());
+    set_ref(src.c_str(), first);
+}
+
+inline void str::set_ref(const str & src, const int first, const int count)
+{
+    STR_ASSERT(first + count <= src.length());
+    set_ref(src.c_str(), first, count);
+}
+
+inline void str::set_ref(const char * src)
+{
+    set_ref(src, 0);
+}
+
+inline void str::set_ref(const std::string & src)
+{
+    set_ref(src.c_str(), 0);
+}
+
+inline void str::set_ref(const std::string & src, const int first)
+{
+    STR_ASSERT(first < narrow<int>(src.length()));
+    set_ref(src.c_str(), first);
+}
+
+inline void str::set_ref(const std::string & src, const int first, const int count)
+{
+    STR_ASSERT(first + count <= narrow<int>(src.length()));
+    set_ref(src.c_str(), first, count);
+}
+
+inline void str::append(const str & src)
+{
+    append(src.c_str(), 0, src.length());
+}
+
+inline void str::append(const str & src, int count)
+{
+    append(src.c_str(), 0, count);
+}
+
+inline void str::append(const str & src, int first, int count)
+{
+    append(src.c_str(), first, count);
+}
+
+inline void str::append(const char * src)
+{
+    append(src, 0, str::length(src));
+}
+
+inline void str::append(const char * src, int count)
+{
+    append(src, 0, count);
+}
+
+inline void str::append(const std::string & src)
+{
+    append(src.c_str(), 0, narrow<int>(src.length()));
+}
+
+inline void str::append(const std::string & src, int count)
+{
+    append(src.c_str(), 0, count);
+}
+
+inline void str::append(const std::string & src, int first, int count)
+{
+    append(src.c_str(), first, count);
+}
+
+inline int str::compare(const str & rhs) const
+{
+    return str::compare(c_str(), rhs.c_str());
+}
+
+inline int str::compare(const char * rhs) const
+{
+    return str::compare(c_str(), rhs);
+}
+
+inline int str::compare(const std::string & rhs) const
+{
+    return str::compare(c_str(), rhs.c_str());
+}
+
+inline int str::compare_no_case(const str & rhs) const
+{
+    return str::compare_no_case(c_str(), rhs.c_str());
+}
+
+inline int str::compare_no_case(const char * rhs) const
+{
+    return str::compare_no_case(c_str(), rhs);
+}
+
+inline int str::compare_no_case(const std::string & rhs) const
+{
+    return str::compare_no_case(c_str(), rhs.c_str());
+}
+
+inline bool str::starts_with(const str & prefix) const
+{
+    return starts_with(prefix.c_str(), prefix.length());
+}
+
+inline bool str::starts_with(const char * prefix) const
+{
+    return starts_with(prefix, str::length(prefix));
+}
+
+inline bool str::starts_with(const std::string & prefix) const
+{
+    return starts_with(prefix.c_str(), narrow<int>(prefix.length()));
+}
+
+inline bool str::ends_with(const str & suffix) const
+{
+    return ends_with(suffix.c_str(), suffix.length());
+}
+
+inline bool str::ends_with(const char * suffix) const
+{
+    return ends_with(suffix, str::length(suffix));
+}
+
+inline bool str::ends_with(const std::string & suffix) const
+{
+    return ends_with(suffix.c_str(), narrow<int>(suffix.length()));
+}
+
+// The str_literal overloads forward the compile-time length into the
+// counted versions - no strlen anywhere on these paths.
+
+inline void str::set(const str_literal & src)
+{
+    set(src.ptr, 0, src.len);
+}
+
+inline void str::append(const str_literal & src)
+{
+    append(src.ptr, 0, src.len);
+}
+
+inline int str::compare(const str_literal & rhs) const
+{
+    return compare(rhs.ptr);
+}
+
+inline bool str::equals(const str_literal & rhs) const
+{
+    return equals(rhs.ptr, rhs.len);
+}
+
+inline bool str::starts_with(const str_literal & prefix) const
+{
+    return starts_with(prefix.ptr, prefix.len);
+}
+
+inline bool str::ends_with(const str_literal & suffix) const
+{
+    return ends_with(suffix.ptr, suffix.len);
+}
+
+inline bool str::starts_with_no_case(const str & prefix) const
+{
+    return starts_with_no_case(prefix.c_str(), prefix.length());
+}
+
+inline bool str::starts_with_no_case(const char * prefix) const
+{
+    return starts_with_no_case(prefix, str::length(prefix));
+}
+
+inline bool str::starts_with_no_case(const std::string & prefix) const
+{
+    return starts_with_no_case(prefix.c_str(), narrow<int>(prefix.length()));
+}
+
+inline bool str::ends_with_no_case(const str & suffix) const
+{
+    return ends_with_no_case(suffix.c_str(), suffix.length());
+}
+
+inline bool str::ends_with_no_case(const char * suffix) const
+{
+    return ends_with_no_case(suffix, str::length(suffix));
+}
+
+inline bool str::ends_with_no_case(const std::string & suffix) const
+{
+    return ends_with_no_case(suffix.c_str(), narrow<int>(suffix.length()));
+}
+
+inline int str::length(const char * str)
+{
+    STR_ASSERT(str != nullptr);
+    return narrow<int>(std::strlen(str)); // Don't care about 32/64-bits truncation.
+}
+
+inline int str::compare(const char * a, const char * b)
+{
+    STR_ASSERT(a != nullptr);
+    STR_ASSERT(b != nullptr);
+
+    return std::strcmp(a, b);
+}
+
+inline int str::compare(const char * a, const char * b, const int chars_to_compare)
+{
+    STR_ASSERT(a != nullptr);
+    STR_ASSERT(b != nullptr);
+
+    return std::strncmp(a, b, chars_to_compare);
+}
+
+inline int str::append(char * dest, const int dest_size_in_chars, const char * source)
+{
+    return append(dest, dest_size_in_chars, source, str::length(source));
+}
+
+inline int str::length() const noexcept
+{
+    return m_length;
+}
+
+inline int str::capacity() const noexcept
+{
+    if (has_big_capacity())
+    {
+        // Real capacity lives in the block header. Read with memcpy -
+        // custom allocators make no alignment promises for the header.
+        std::int32_t real_capacity;
+        std::memcpy(&real_capacity, m_data - big_capacity_header_size, sizeof(real_capacity));
+        return real_capacity;
+    }
+    return static_cast<int>(m_capacity);
+}
+
+inline int str::local_buffer_size() const noexcept
+{
+    return static_cast<int>(m_local_buffer_size);
+}
+
+inline bool str::empty() const noexcept
+{
+    return m_length == 0;
+}
+
+inline bool str::valid() const noexcept
+{
+    // True once the string has storage of its own (or references
+    // someone else's). Zero length doesn't make a string invalid -
+    // an empty payload is a perfectly good payload.
+    return m_data != get_empty_dummy_string();
+}
+
+inline bool str::is_ascii() const noexcept
+{
+    return is_ascii(m_data, m_length);
+}
+
+inline bool str::validate_utf8() const noexcept
+{
+    return validate_utf8(m_data, m_length);
+}
+
+inline bool str::owns_buffer() const noexcept
+{
+    return !!m_owns_buffer; // Double NOT to silence conversion from integer=>bool warning.
+}
+
+inline bool str::using_local_buffer() const noexcept
+{
+    return m_data == get_local_buffer() && local_buffer_size() > 0;
+}
+
+inline const char * str::c_str() const noexcept
+{
+    return m_data;
+}
+
+inline const char * str::data() const noexcept
+{
+    return m_data;
+}
+
+inline std::string str::std_str() const
+{
+    return std::string{ m_data, static_cast<std::size_t>(m_length) };
+}
+
+inline char * str::get_local_buffer() const noexcept
+{
+    // NOTE: The local buffer is assumed to be whatever follows the class instance.
+    // This is somewhat hackish and potentially fragile, but avoids the need for a
+    // virtual function or a fully templated string class. As long as the layout of
+    // str remains simple (no virtual inheritance), this should work fine.
+    auto base = const_cast<str *>(this);
+    return reinterpret_cast<char *>(base) + sizeof(str);
+}
+
+inline void str::clear_no_free() noexcept
+{
+    if (m_data != get_empty_dummy_string())
+    {
+        m_data[0] = '\0';
+        m_length  = 0;
+    }
+}
+
+inline int str::grow_capacity(const int chars_needed) const noexcept
+{
+    // Clamp the geometric target once capacities approach INT_MAX,
+    // so the multiply below can't overflow for huge strings.
+    const int current = capacity();
+    const int grown = (current < 0x40000000 ? STR_GROWTH_FACTOR(current) : 0x7FFFFFFF);
+    return (grown > chars_needed ? grown : chars_needed);
+}
+
+inline void str::reserve_for_append(const int chars_needed)
+{
+    if (capacity() < chars_needed)
+    {
+        // The geometric target already includes the slack,
+        // so no fixed dynamic_alloc_extra on top.
+        reserve(grow_capacity(chars_needed), 0);
+    }
+}
+
+inline void str::push_back(const char c)
+{
+    reserve_for_append(m_length + 2);
+    m_data[m_length++] = c;
+    m_data[m_length  ] = '\0';
+}
+
+inline void str::pop_back()
+{
+    if (m_length > 0)
+    {
+        m_data[--m_length] = '\0';
+    }
+}
+
+// ================== End of header file ==================
+#endif // STR_HPP
+// ================== End of header file ==================
+
+// ================================================================================================
+//
+//                                     Str Implementation
+//
+// ================================================================================================
+
+#ifdef STR_IMPLEMENTATION
+
+// 12 bytes on a 32bits machine, 16 on 64bits.
+static_assert(sizeof(str) == (sizeof(char *) == 4 ? 12 : 16), "size of str class should not be greater than 16 bytes!");
+
+// Need to maintain plain data layout for str::get_local_buffer() to work.
+static_assert(!std::is_polymorphic<str>::value, "str class will not work with virtual inheritance!");
+
+// Assert we don't have any unexpected padding:
+#ifndef STR_SIZED_NO_GLOBAL_ALIASES
+    static_assert(sizeof(str16)  == sizeof(str) + 16,  "unexpected size!");
+    static_assert(sizeof(str32)  == sizeof(str) + 32,  "unexpected size!");
+    static_assert(sizeof(str64)  == sizeof(str) + 64,  "unexpected size!");
+    static_assert(sizeof(str128) == sizeof(str) + 128, "unexpected size!");
+    static_assert(sizeof(str256) == sizeof(str) + 256, "unexpected size!");
+    static_assert(sizeof(str512) == sizeof(str) + 512, "unexpected size!");
+#endif // STR_SIZED_NO_GLOBAL_ALIASES
+
+// On some platform vsnprintf() takes va_list by reference and modifies it.
+// va_copy is the 'correct' way to copy a va_list but Visual Studio prior to 2013 doesn't have it.
+#if (defined(_MSC_VER) && (_MSC_VER <= 1700))
+    #ifndef va_copy
+        #define va_copy(dest, src) (dest = src)
+    #endif // va_copy
+#endif // _MSC_VER
+
+// ========================================================
+// str::hash():
+// ========================================================
+
+std::uint64_t str::hash(const char * data, const int len)
+{
+    STR_ASSERT(data != nullptr);
+    STR_ASSERT(len  >= 0);
+
+    // MurmurHash64A-style mixing over 8-byte blocks. Not cryptographic,
+    // but fast and well distributed for hash table keys.
+    const std::uint64_t m = 0xC6A4A7935BD1E995ull;
+    const int r = 47;
+
+    std::uint64_t h = 0x9E3779B97F4A7C15ull ^ (static_cast<std::uint64_t>(len) * m);
+
+    int i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        std::uint64_t k;
+        std::memcpy(&k, data + i, 8); // Unaligned-safe load.
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    if (i < len) // Up to 7 tail bytes:
+    {
+        std::uint64_t tail = 0;
+        std::memcpy(&tail, data + i, len - i);
+        h ^= tail;
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// ========================================================
+// class str_tokenizer implementation:
+// ========================================================
+
+str_tokenizer::str_tokenizer(const str & source, const char * delimiters)
+    : m_source{ source.c_str() }
+    , m_source_len{ source.length() }
+    , m_pos{ 0 }
+    , m_delim_bits{}
+{
+    build_delimiter_bitmap(delimiters);
+}
+
+str_tokenizer::str_tokenizer(const char * source, const int source_len, const char * delimiters)
+    : m_source{ source }
+    , m_source_len{ source_len }
+    , m_pos{ 0 }
+    , m_delim_bits{}
+{
+    STR_ASSERT(source != nullptr);
+    STR_ASSERT(source_len >= 0);
+    build_delimiter_bitmap(delimiters);
+}
+
+void str_tokenizer::build_delimiter_bitmap(const char * delimiters)
+{
+    STR_ASSERT(delimiters != nullptr);
+
+    for (const char * ptr = delimiters; *ptr != '\0'; ++ptr)
+    {
+        const unsigned char u = static_cast<unsigned char>(*ptr);
+        m_delim_bits[u >> 5] |= (1u << (u & 31));
+    }
+}
+
+bool str_tokenizer::next_token(str_ref & out_token)
+{
+    int pos = m_pos;
+
+    // Skip leading delimiters:
+    while (pos < m_source_len && is_delimiter(m_source[pos]))
+    {
+        ++pos;
+    }
+
+    if (pos == m_source_len)
+    {
+        m_pos = pos;
+        return false; // Source exhausted.
+    }
+
+    // Scan to the end of the token:
+    const int token_start = pos;
+    while (pos < m_source_len && !is_delimiter(m_source[pos]))
+    {
+        ++pos;
+    }
+
+    out_token.set_ref(m_source, token_start, pos - token_start);
+    m_pos = pos;
+    return true;
+}
+
+// ========================================================
+// class str_line_reader implementation:
+// ========================================================
+
+str_line_reader::str_line_reader(const char * buffer, const int buffer_len, const bool last_chunk)
+    : m_buffer{ buffer }
+    , m_buffer_len{ buffer_len }
+    , m_pos{ 0 }
+    , m_last_chunk{ last_chunk }
+    , m_carry_yielded{ false }
+    , m_carry{}
+{
+    STR_ASSERT(buffer != nullptr);
+    STR_ASSERT(buffer_len >= 0);
+}
+
+str_line_reader::str_line_reader(const str & buffer)
+    : str_line_reader{ buffer.c_str(), buffer.length(), true }
+{
+}
+
+void str_line_reader::refill(const char * buffer, const int buffer_len, const bool last_chunk)
+{
+    STR_ASSERT(buffer != nullptr);
+    STR_ASSERT(buffer_len >= 0);
+    STR_ASSERT(m_pos >= m_buffer_len); // Refilling would drop unread lines otherwise.
+
+    if (m_carry_yielded)
+    {
+        m_carry.clear_no_free();
+        m_carry_yielded = false;
+    }
+
+    m_buffer     = buffer;
+    m_buffer_len = buffer_len;
+    m_pos        = 0;
+    m_last_chunk = last_chunk;
+}
+
+bool str_line_reader::next_line(str_ref & out_line)
+{
+    if (m_carry_yielded)
+    {
+        // The slice handed out last time pointed into m_carry;
+        // the caller is done with it now, so reclaim the space.
+        m_carry.clear_no_free();
+        m_carry_yielded = false;
+    }
+
+    if (!m_carry.empty())
+    {
+        // A partial line was carried across the last refill -
+        // complete it from the current chunk and hand it out whole.
+        const void * found = nullptr;
+        if (m_pos < m_buffer_len)
+        {
+            found = std::memchr(m_buffer + m_pos, '\n', m_buffer_len - m_pos);
+        }
+
+        if (found != nullptr)
+        {
+            const int count = static_cast<int>(static_cast<const char *>(found) - (m_buffer + m_pos));
+            m_carry.append(m_buffer + m_pos, count);
+            m_pos += count + 1;
+
+            if (!m_carry.empty() && m_carry[m_carry.length() - 1] == '\r')
+            {
+                m_carry.truncate(m_carry.length() - 1);
+            }
+        }
+        else
+        {
+            if (m_pos < m_buffer_len)
+            {
+                m_carry.append(m_buffer + m_pos, m_buffer_len - m_pos);
+                m_pos = m_buffer_len;
+            }
+            if (!m_last_chunk)
+            {
+                return false; // Still unterminated - wait for more input.
+            }
+            // End of all input: the carried text is the final line.
+        }
+
+        out_line.set_ref(m_carry.c_str(), 0, m_carry.length());
+        m_carry_yielded = true;
+        return true;
+    }
+
+    if (m_pos >= m_buffer_len)
+    {
+        return false; // Exhausted.
+    }
+
+    const char * const line_start = m_buffer + m_pos;
+    const void * found = std::memchr(line_start, '\n', m_buffer_len - m_pos);
+
+    if (found == nullptr)
+    {
+        // Unterminated trailing text. Yield it as the final line if this
+        // is the last chunk, otherwise carry it into the next refill.
+        const int count = m_buffer_len - m_pos;
+        if (m_last_chunk)
+        {
+            out_line.set_ref(m_buffer, m_pos, count);
+            m_pos = m_buffer_len;
+            return true;
+        }
+
+        m_carry.set(line_start, count);
+        m_pos = m_buffer_len;
+        return false;
+    }
+
+    int line_len = static_cast<int>(static_cast<const char *>(found) - line_start);
+    const int next_pos = m_pos + line_len + 1; // Skip past the '\n'.
+
+    if (line_len > 0 && line_start[line_len - 1] == '\r')
+    {
+        --line_len;
+    }
+
+    out_line.set_ref(m_buffer, m_pos, line_len);
+    m_pos = next_pos;
+    return true;
+}
+
+// ========================================================
+// str_allocator binding and str_arena:
+// ========================================================
+
+static thread_local str_allocator * s_thread_allocator = nullptr;
+
+str_allocator * str_set_allocator(str_allocator * allocator) noexcept
+{
+    str_allocator * previous = s_thread_allocator;
+    s_thread_allocator = allocator;
+    return previous;
+}
+
+str_allocator * str_get_allocator() noexcept
+{
+    return s_thread_allocator;
+}
+
+static char * str_raw_alloc(const int size_in_bytes)
+{
+    if (s_thread_allocator != nullptr)
+    {
+        return s_thread_allocator->alloc_fn(size_in_bytes, s_thread_allocator->user_data);
+    }
+    return STR_MEM_ALLOC(size_in_bytes);
+}
+
+static char * str_raw_realloc(char * ptr, const int bytes_to_preserve, const int new_size_in_bytes)
+{
+    if (s_thread_allocator != nullptr)
+    {
+        if (s_thread_allocator->realloc_fn != nullptr)
+        {
+            return s_thread_allocator->realloc_fn(ptr, new_size_in_bytes, s_thread_allocator->user_data);
+        }
+
+        // Allocator has no realloc - emulate with alloc + copy + free.
+        char * new_ptr = s_thread_allocator->alloc_fn(new_size_in_bytes, s_thread_allocator->user_data);
+        STR_ASSERT(new_ptr != nullptr);
+        std::memcpy(new_ptr, ptr, bytes_to_preserve);
+        s_thread_allocator->free_fn(ptr, s_thread_allocator->user_data);
+        return new_ptr;
+    }
+
+#ifdef STR_MEM_REALLOC
+    (void)bytes_to_preserve;
+    return STR_MEM_REALLOC(ptr, new_size_in_bytes);
+#else // !STR_MEM_REALLOC
+    char * new_ptr = STR_MEM_ALLOC(new_size_in_bytes);
+    STR_ASSERT(new_ptr != nullptr);
+    std::memcpy(new_ptr, ptr, bytes_to_preserve);
+    STR_MEM_FREE(ptr);
+    return new_ptr;
+#endif // STR_MEM_REALLOC
+}
+
+static void str_raw_free(char * ptr)
+{
+    if (s_thread_allocator != nullptr)
+    {
+        s_thread_allocator->free_fn(ptr, s_thread_allocator->user_data);
+        return;
+    }
+    STR_MEM_FREE(ptr);
+}
+
+#ifdef STR_ENABLE_STATS
+
+static thread_local str_stats s_thread_stats = {};
+
+// Size header prepended to every block while stats are enabled.
+// 8 bytes keeps the payload as aligned as the allocator returned it.
+static const int str_stats_header_size = 8;
+
+// Writes the size header and charges the block to the live counters.
+// Returns the payload pointer handed out to the rest of the library.
+static char * str_stats_commit_block(char * block, const int payload_size)
+{
+    STR_ASSERT(block != nullptr);
+
+    const std::int64_t size64 = payload_size;
+    std::memcpy(block, &size64, sizeof(size64));
+
+    s_thread_stats.live_bytes += static_cast<std::uint64_t>(payload_size);
+    if (s_thread_stats.live_bytes > s_thread_stats.peak_live_bytes)
+    {
+        s_thread_stats.peak_live_bytes = s_thread_stats.live_bytes;
+    }
+    return block + str_stats_header_size;
+}
+
+// Reads back the size a block was charged with when it was committed.
+static std::int64_t str_stats_block_size(const char * payload)
+{
+    std::int64_t size64;
+    std::memcpy(&size64, payload - str_stats_header_size, sizeof(size64));
+    return size64;
+}
+
+str_stats str_get_stats() noexcept
+{
+    return s_thread_stats;
+}
+
+void str_reset_stats() noexcept
+{
+    const std::uint64_t live = s_thread_stats.live_bytes;
+    s_thread_stats = str_stats{};
+    s_thread_stats.live_bytes      = live;
+    s_thread_stats.peak_live_bytes = live;
+}
+
+#define STR_STATS_INCREMENT(counter) (++s_thread_stats.counter)
+
+#else // !STR_ENABLE_STATS
+
+#define STR_STATS_INCREMENT(counter) ((void)0)
+
+#endif // STR_ENABLE_STATS
+
+char * str::mem_alloc(const int size_in_bytes)
+{
+#ifdef STR_ENABLE_STATS
+    STR_STATS_INCREMENT(alloc_calls);
+    s_thread_stats.bytes_requested += static_cast<std::uint64_t>(size_in_bytes);
+
+    char * block = str_raw_alloc(size_in_bytes + str_stats_header_size);
+    return str_stats_commit_block(block, size_in_bytes);
+#else // !STR_ENABLE_STATS
+    return str_raw_alloc(size_in_bytes);
+#endif // STR_ENABLE_STATS
+}
+
+char * str::mem_realloc(char * ptr, const int bytes_to_preserve, const int new_size_in_bytes)
+{
+#ifdef STR_ENABLE_STATS
+    STR_STATS_INCREMENT(realloc_calls);
+    s_thread_stats.bytes_requested += static_cast<std::uint64_t>(new_size_in_bytes);
+    s_thread_stats.live_bytes      -= static_cast<std::uint64_t>(str_stats_block_size(ptr));
+
+    char * block = str_raw_realloc(ptr - str_stats_header_size,
+                                   bytes_to_preserve + str_stats_header_size,
+                                   new_size_in_bytes + str_stats_header_size);
+    return str_stats_commit_block(block, new_size_in_bytes);
+#else // !STR_ENABLE_STATS
+    return str_raw_realloc(ptr, bytes_to_preserve, new_size_in_bytes);
+#endif // STR_ENABLE_STATS
+}
+
+void str::mem_free(char * ptr)
+{
+#ifdef STR_ENABLE_STATS
+    STR_STATS_INCREMENT(free_calls);
+    s_thread_stats.live_bytes -= static_cast<std::uint64_t>(str_stats_block_size(ptr));
+    str_raw_free(ptr - str_stats_header_size);
+#else // !STR_ENABLE_STATS
+    str_raw_free(ptr);
+#endif // STR_ENABLE_STATS
+}
+
+char * str::heap_alloc_chars(const int capacity_in_chars)
+{
+    if (capacity_in_chars < static_cast<int>(big_capacity_sentinel))
+    {
+        return mem_alloc(capacity_in_chars);
+    }
+
+    // Too big for the capacity bitfield - prepend the real size.
+    char * block = mem_alloc(capacity_in_chars + big_capacity_header_size);
+    STR_ASSERT(block != nullptr);
+
+    const std::int32_t real_capacity = capacity_in_chars;
+    std::memcpy(block, &real_capacity, sizeof(real_capacity));
+    return block + big_capacity_header_size;
+}
+
+char * str::heap_realloc_chars(const int bytes_to_preserve, const int new_capacity) const
+{
+    const bool was_big = has_big_capacity();
+    const bool now_big = (new_capacity >= static_cast<int>(big_capacity_sentinel));
+
+    if (!was_big && !now_big)
+    {
+        return mem_realloc(m_data, bytes_to_preserve, new_capacity);
+    }
+
+    if (was_big)
+    {
+        // The block already has a header - realloc it along with the
+        // chars. Shrinking below the threshold keeps the header (and
+        // the caller keeps the sentinel), so the block start stays
+        // where a later free expects it.
+        char * block = mem_realloc(m_data - big_capacity_header_size,
+                                   bytes_to_preserve + big_capacity_header_size,
+                                   new_capacity + big_capacity_header_size);
+        STR_ASSERT(block != nullptr);
+
+        const std::int32_t real_capacity = new_capacity;
+        std::memcpy(block, &real_capacity, sizeof(real_capacity));
+        return block + big_capacity_header_size;
+    }
+
+    // Headerless block growing past the threshold: realloc can't shift
+    // the payload over the new header, so allocate-copy-free instead.
+    char * new_data = heap_alloc_chars(new_capacity);
+    std::memcpy(new_data, m_data, bytes_to_preserve);
+    mem_free(m_data);
+    return new_data;
+}
+
+void str::free_heap_buffer()
+{
+    STR_ASSERT(m_owns_buffer && !using_local_buffer());
+    STR_ASSERT(m_data != get_empty_dummy_string());
+    mem_free(has_big_capacity() ? (m_data - big_capacity_header_size) : m_data);
+}
+
+str_arena::str_arena(const int block_size)
+    : m_block_list{ nullptr }
+    , m_block_size{ block_size }
+    , m_total_bytes{ 0 }
+    , m_allocator{ &str_arena::alloc_callback, &str_arena::free_callback, nullptr, this }
+{
+    STR_ASSERT(block_size > 0);
+}
+
+str_arena::~str_arena()
+{
+    release_all();
+}
+
+char * str_arena::allocate(const int size_in_bytes)
+{
+    STR_ASSERT(size_in_bytes > 0);
+
+    block * b = m_block_list;
+    if (b == nullptr || (b->size - b->used) < size_in_bytes)
+    {
+        b = push_new_block(size_in_bytes);
+    }
+
+    char * ptr = reinterpret_cast<char *>(b + 1) + b->used;
+    b->used += size_in_bytes;
+    return ptr;
+}
+
+void str_arena::release_all()
+{
+    for (block * b = m_block_list; b != nullptr;)
+    {
+        block * next = b->next;
+        STR_MEM_FREE(reinterpret_cast<char *>(b));
+        b = next;
+    }
+
+    m_block_list  = nullptr;
+    m_total_bytes = 0;
+}
+
+str_arena::block * str_arena::push_new_block(const int min_payload_size)
+{
+    // Oversized requests get a dedicated block; everything else
+    // shares blocks of the configured size.
+    const int payload_size = (min_payload_size > m_block_size ? min_payload_size : m_block_size);
+    const int total_size   = static_cast<int>(sizeof(block)) + payload_size;
+
+    block * b = reinterpret_cast<block *>(STR_MEM_ALLOC(total_size));
+    STR_ASSERT(b != nullptr);
+
+    b->next = m_block_list;
+    b->used = 0;
+    b->size = payload_size;
+
+    m_block_list   = b;
+    m_total_bytes += total_size;
+    return b;
+}
+
+char * str_arena::alloc_callback(const int size_in_bytes, void * user_data)
+{
+    return static_cast<str_arena *>(user_data)->allocate(size_in_bytes);
+}
+
+void str_arena::free_callback(char * /* ptr */, void * /* user_data */)
+{
+    // Individual frees are no-ops - memory is reclaimed by release_all().
+}
+
+// ========================================================
+// class str_intern_table implementation:
+// ========================================================
+
+str_intern_table::~str_intern_table()
+{
+    for (int i = 0; i < shard_count; ++i)
+    {
+        if (m_shards[i].entries != nullptr)
+        {
+            STR_MEM_FREE(reinterpret_cast<char *>(m_shards[i].entries));
+        }
+        // The shard arenas free the string payloads on their own destruction.
+    }
+}
+
+const char * str_intern_table::intern(const char * s)
+{
+    STR_ASSERT(s != nullptr);
+    return intern(s, str::length(s));
+}
+
+const char * str_intern_table::intern(const str & s)
+{
+    return intern(s.c_str(), s.length());
+}
+
+const char * str_intern_table::intern(const char * s, const int len)
+{
+    STR_ASSERT(s != nullptr);
+    STR_ASSERT(len >= 0);
+
+    const std::uint64_t h = str::hash(s, len);
+
+    // Shard selection uses the high hash bits; the bucket index below
+    // uses the low bits, so the two don't correlate.
+    shard & sh = m_shards[(h >> 56) & (shard_count - 1)];
+
+#ifdef STR_INTERN_THREAD_SAFE
+    std::lock_guard<std::mutex> hold{ sh.lock };
+#endif // STR_INTERN_THREAD_SAFE
+
+    return intern_in_shard(sh, h, s, len);
+}
+
+int str_intern_table::size() const noexcept
+{
+    int total = 0;
+    for (int i = 0; i < shard_count; ++i)
+    {
+        total += m_shards[i].used;
+    }
+    return total;
+}
+
+const char * str_intern_table::intern_in_shard(shard & sh, const std::uint64_t hash, const char * str_data, const int len)
+{
+    // Grow at 3/4 occupancy to keep probe sequences short.
+    if ((sh.used + 1) * 4 >= sh.bucket_count * 3)
+    {
+        grow_shard(sh);
+    }
+
+    const std::uint64_t mask = static_cast<std::uint64_t>(sh.bucket_count - 1);
+    for (std::uint64_t i = hash & mask; /* until empty slot */; i = (i + 1) & mask)
+    {
+        entry & e = sh.entries[i];
+        if (e.ptr == nullptr) // Empty slot - first sighting, insert.
+        {
+            char * copy = sh.arena.allocate(len + 1);
+            std::memcpy(copy, str_data, len);
+            copy[len] = '\0';
+
+            e.hash = hash;
+            e.ptr  = copy;
+            e.len  = len;
+
+            sh.used++;
+            return copy;
+        }
+        if (e.hash == hash && e.len == len && std::memcmp(e.ptr, str_data, len) == 0)
+        {
+            return e.ptr; // Already interned - hand out the canonical pointer.
+        }
+    }
+}
+
+void str_intern_table::grow_shard(shard & sh)
+{
+    const int old_bucket_count = sh.bucket_count;
+    entry * old_entries = sh.entries;
+
+    const int new_bucket_count = (old_bucket_count != 0 ? old_bucket_count * 2 : 64);
+    entry * new_entries = reinterpret_cast<entry *>(STR_MEM_ALLOC(new_bucket_count * sizeof(entry)));
+    STR_ASSERT(new_entries != nullptr);
+    std::memset(new_entries, 0, new_bucket_count * sizeof(entry));
+
+    // Rehash into the bigger table. Interned pointers live in the
+    // arena and are untouched, so handles stay valid across growth.
+    const std::uint64_t mask = static_cast<std::uint64_t>(new_bucket_count - 1);
+    for (int i = 0; i < old_bucket_count; ++i)
+    {
+        const entry & e = old_entries[i];
+        if (e.ptr == nullptr)
+        {
+            continue;
+        }
+
+        std::uint64_t slot = e.hash & mask;
+        while (new_entries[slot].ptr != nullptr)
+        {
+            slot = (slot + 1) & mask;
+        }
+        new_entries[slot] = e;
+    }
+
+    sh.entries      = new_entries;
+    sh.bucket_count = new_bucket_count;
+
+    if (old_entries != nullptr)
+    {
+        STR_MEM_FREE(reinterpret_cast<char *>(old_entries));
+    }
+}
+
+// ========================================================
+// class str_shared implementation:
+// ========================================================
+
+str_shared::shared_block * str_shared::make_block(const char * const chars, const int len)
+{
+    STR_ASSERT(chars != nullptr);
+    STR_ASSERT(len > 0);
+
+    char * memory = mem_alloc(static_cast<int>(sizeof(shared_block)) + len + 1);
+    STR_ASSERT(memory != nullptr);
+
+    shared_block * block = reinterpret_cast<shared_block *>(memory);
+    new (&block->refs) std::atomic<int>{ 1 };
+    block->length = len;
+
+    char * dest = block_chars(block);
+    std::memcpy(dest, chars, len);
+    dest[len] = '\0';
+    return block;
+}
+
+void str_shared::add_ref(shared_block * const block) noexcept
+{
+    STR_ASSERT(block != nullptr);
+    block->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void str_shared::release(shared_block * const block) noexcept
+{
+    STR_ASSERT(block != nullptr);
+
+    // acq_rel so the last releaser observes every write made
+    // to the block before the other references dropped theirs.
+    if (block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        mem_free(reinterpret_cast<char *>(block)); // std::atomic<int> is trivially destructible.
+    }
+}
+
+void str_shared::share(const char * const chars, const int len)
+{
+    adopt((len > 0) ? make_block(chars, len) : nullptr);
+}
+
+void str_shared::adopt(shared_block * const block)
+{
+    shared_block * const old_block = m_block;
+    m_block = block;
+
+    if (block != nullptr)
+    {
+        set_ref(block_chars(block), 0, block->length);
+    }
+    else
+    {
+        clear(); // set_ref/clear also free any private buffer a mutation left us with.
+    }
+
+    if (old_block != nullptr)
+    {
+        release(old_block);
+    }
+}
+
+bool str_shared::viewing_block() const noexcept
+{
+    return (m_block != nullptr) && (m_data == block_chars(m_block));
+}
+
+str_shared::str_shared(const str_shared & rhs)
+    : str{}
+{
+    if (rhs.viewing_block())
+    {
+        add_ref(rhs.m_block);
+        adopt(rhs.m_block);
+    }
+    else
+    {
+        // rhs was detached by a mutation - start a fresh
+        // block so further copies of this one are O(1) again.
+        share(rhs.c_str(), rhs.length());
+    }
+}
+
+str_shared & str_shared::operator = (const str_shared & rhs)
+{
+    if (this == &rhs)
+    {
+        return *this;
+    }
+
+    if (rhs.viewing_block())
+    {
+        add_ref(rhs.m_block);
+        adopt(rhs.m_block);
+    }
+    else
+    {
+        adopt(nullptr);
+        share(rhs.c_str(), rhs.length());
+    }
+    return *this;
+}
+
+str_shared::str_shared(str_shared && rhs) noexcept
+    : str{ static_cast<str &&>(rhs) }
+    , m_block{ rhs.m_block }
+{
+    rhs.m_block = nullptr;
+}
+
+str_shared & str_shared::operator = (str_shared && rhs) noexcept
+{
+    if (this == &rhs)
+    {
+        return *this;
+    }
+
+    shared_block * const old_block = m_block;
+
+    str::operator = (static_cast<str &&>(rhs));
+    m_block = rhs.m_block;
+    rhs.m_block = nullptr;
+
+    if (old_block != nullptr)
+    {
+        release(old_block);
+    }
+    return *this;
+}
+
+str_shared::~str_shared()
+{
+    // The base destructor frees any private buffer a mutation left behind.
+    if (m_block != nullptr)
+    {
+        release(m_block);
+    }
+}
+
+void str_shared::detach()
+{
+    if (!viewing_block())
+    {
+        return;
+    }
+
+    shared_block * const block = m_block;
+    m_block = nullptr;
+
+    // set() copies into fresh private storage; the source block
+    // stays valid underneath it until the release below.
+    set(block_chars(block), 0, block->length);
+    release(block);
+}
+
+bool str_shared::is_shared() const noexcept
+{
+    return viewing_block();
+}
+
+int str_shared::ref_count() const noexcept
+{
+    return viewing_block() ? m_block->refs.load(std::memory_order_relaxed) : 0;
+}
+
+// ========================================================
+// class str_builder implementation:
+// ========================================================
+
+str_builder::str_builder() noexcept
+    : m_frags{ m_local_frags }
+    , m_frag_count{ 0 }
+    , m_frag_capacity{ local_fragment_count }
+    , m_total_length{ 0 }
+    , m_scratch_list{ nullptr }
+    , m_local_frags{}
+{
+}
+
+str_builder::~str_builder()
+{
+    for (scratch_block * b = m_scratch_list; b != nullptr;)
+    {
+        scratch_block * next = b->next;
+        STR_MEM_FREE(reinterpret_cast<char *>(b));
+        b = next;
+    }
+
+    if (m_frags != m_local_frags)
+    {
+        STR_MEM_FREE(reinterpret_cast<char *>(m_frags));
+    }
+}
+
+str_builder & str_builder::append(const str & src)
+{
+    push_fragment(src.c_str(), src.length());
+    return *this;
+}
+
+str_builder & str_builder::append(const char * src)
+{
+    STR_ASSERT(src != nullptr);
+    push_fragment(src, str::length(src));
+    return *this;
+}
+
+str_builder & str_builder::append(const char * src, const int count)
+{
+    STR_ASSERT(src != nullptr);
+    STR_ASSERT(count >= 0);
+    push_fragment(src, count);
+    return *this;
+}
+
+str_builder & str_builder::append(const std::string & src)
+{
+    push_fragment(src.c_str(), static_cast<int>(src.length()));
+    return *this;
+}
+
+str_builder & str_builder::append(const char c)
+{
+    char * storage = scratch_alloc(1);
+    storage[0] = c;
+    push_fragment(storage, 1);
+    return *this;
+}
+
+str_builder & str_builder::append_int(const long long value)
+{
+    char temp[32];
+    const int len = std::snprintf(temp, sizeof(temp), "%lld", value);
+    STR_ASSERT(len > 0);
+
+    char * storage = scratch_alloc(len);
+    std::memcpy(storage, temp, len);
+    push_fragment(storage, len);
+    return *this;
+}
+
+str_builder & str_builder::append_uint(const unsigned long long value)
+{
+    char temp[32];
+    const int len = std::snprintf(temp, sizeof(temp), "%llu", value);
+    STR_ASSERT(len > 0);
+
+    char * storage = scratch_alloc(len);
+    std::memcpy(storage, temp, len);
+    push_fragment(storage, len);
+    return *this;
+}
+
+str_builder & str_builder::append_float(const double value, const int decimal_digits)
+{
+    char temp[64];
+    const int len = std::snprintf(temp, sizeof(temp), "%.*f", decimal_digits, value);
+    STR_ASSERT(len > 0 && len < static_cast<int>(sizeof(temp)));
+
+    char * storage = scratch_alloc(len);
+    std::memcpy(storage, temp, len);
+    push_fragment(storage, len);
+    return *this;
+}
+
+void str_builder::to_string(str & dest) const
+{
+    // Single allocation for the exact total, then one pass of copies.
+    // reserve_discard() is a no-op when dest is already big enough, so
+    // clear explicitly first.
+    dest.clear_no_free();
+    dest.reserve_discard(m_total_length + 1, 0);
+
+    for (int i = 0; i < m_frag_count; ++i)
+    {
+        dest.append(m_frags[i].ptr, m_frags[i].len);
+    }
+}
+
+void str_builder::reset() noexcept
+{
+    m_frag_count   = 0;
+    m_total_length = 0;
+
+    for (scratch_block * b = m_scratch_list; b != nullptr; b = b->next)
+    {
+        b->used = 0;
+    }
+}
+
+void str_builder::push_fragment(const char * ptr, const int len)
+{
+    if (len <= 0)
+    {
+        return;
+    }
+
+    if (m_frag_count == m_frag_capacity)
+    {
+        const int new_capacity = m_frag_capacity * 2;
+        fragment * new_frags = reinterpret_cast<fragment *>(STR_MEM_ALLOC(new_capacity * static_cast<int>(sizeof(fragment))));
+        STR_ASSERT(new_frags != nullptr);
+
+        std::memcpy(new_frags, m_frags, m_frag_count * sizeof(fragment));
+        if (m_frags != m_local_frags)
+        {
+            STR_MEM_FREE(reinterpret_cast<char *>(m_frags));
+        }
+
+        m_frags         = new_frags;
+        m_frag_capacity = new_capacity;
+    }
+
+    m_frags[m_frag_count].ptr = ptr;
+    m_frags[m_frag_count].len = len;
+    ++m_frag_count;
+    m_total_length += len;
+}
+
+// ========================================================
+// class str_array implementation:
+// ========================================================
+
+// Raw block grow helper for the str_array index/char blocks. Uses the
+// realloc hook when available so in-place extension is possible.
+static char * str_array_realloc(char * ptr, const int old_size, const int new_size)
+{
+    if (ptr == nullptr)
+    {
+        return STR_MEM_ALLOC(new_size);
+    }
+#ifdef STR_MEM_REALLOC
+    (void)old_size;
+    return STR_MEM_REALLOC(ptr, new_size);
+#else // !STR_MEM_REALLOC
+    char * new_ptr = STR_MEM_ALLOC(new_size);
+    STR_ASSERT(new_ptr != nullptr);
+    std::memcpy(new_ptr, ptr, (old_size < new_size ? old_size : new_size));
+    STR_MEM_FREE(ptr);
+    return new_ptr;
+#endif // STR_MEM_REALLOC
+}
+
+str_array::str_array() noexcept
+    : m_chars{ nullptr }
+    , m_chars_used{ 0 }
+    , m_chars_capacity{ 0 }
+    , m_offsets{ nullptr }
+    , m_count{ 0 }
+    , m_offsets_capacity{ 0 }
+{
+}
+
+str_array::~str_array()
+{
+    if (m_chars != nullptr)
+    {
+        STR_MEM_FREE(m_chars);
+    }
+    if (m_offsets != nullptr)
+    {
+        STR_MEM_FREE(reinterpret_cast<char *>(m_offsets));
+    }
+}
+
+void str_array::push_back(const str & s)
+{
+    push_back(s.c_str(), s.length());
+}
+
+void str_array::push_back(const char * s)
+{
+    STR_ASSERT(s != nullptr);
+    push_back(s, str::length(s));
+}
+
+void str_array::push_back(const std::string & s)
+{
+    push_back(s.c_str(), static_cast<int>(s.length()));
+}
+
+void str_array::push_back(const char * s, const int len)
+{
+    STR_ASSERT(s   != nullptr);
+    STR_ASSERT(len >= 0);
+
+    if (m_chars_used + len + 1 > m_chars_capacity)
+    {
+        grow_chars(m_chars_used + len + 1);
+    }
+    if (m_count + 1 >= m_offsets_capacity) // +1 for the end sentinel.
+    {
+        grow_offsets();
+    }
+
+    std::memcpy(m_chars + m_chars_used, s, len);
+    m_chars[m_chars_used + len] = '\0';
+
+    m_offsets[m_count] = m_chars_used;
+    m_chars_used += len + 1;
+    ++m_count;
+    m_offsets[m_count] = m_chars_used; // End sentinel keeps lengths table-free.
+}
+
+str_ref str_array::operator[](const int index) const
+{
+    STR_ASSERT(index >= 0);
+    STR_ASSERT(index < m_count);
+
+    const int start = m_offsets[index];
+    const int len   = m_offsets[index + 1] - start - 1; // Minus the terminator.
+    return str_ref{ m_chars, start, len };
+}
+
+void str_array::clear() noexcept
+{
+    m_chars_used = 0;
+    m_count      = 0;
+}
+
+void str_array::shrink_to_fit()
+{
+    if (m_count == 0) // Give everything back.
+    {
+        if (m_chars != nullptr)
+        {
+            STR_MEM_FREE(m_chars);
+            m_chars          = nullptr;
+            m_chars_capacity = 0;
+        }
+        if (m_offsets != nullptr)
+        {
+            STR_MEM_FREE(reinterpret_cast<char *>(m_offsets));
+            m_offsets          = nullptr;
+            m_offsets_capacity = 0;
+        }
+        return;
+    }
+
+    if (m_chars_used < m_chars_capacity)
+    {
+        m_chars          = str_array_realloc(m_chars, m_chars_capacity, m_chars_used);
+        m_chars_capacity = m_chars_used;
+        STR_ASSERT(m_chars != nullptr);
+    }
+
+    const int offsets_needed = m_count + 1;
+    if (offsets_needed < m_offsets_capacity)
+    {
+        m_offsets = reinterpret_cast<int *>(str_array_realloc(
+            reinterpret_cast<char *>(m_offsets),
+            m_offsets_capacity * static_cast<int>(sizeof(int)),
+            offsets_needed * static_cast<int>(sizeof(int))));
+        m_offsets_capacity = offsets_needed;
+        STR_ASSERT(m_offsets != nullptr);
+    }
 }
 
-inline bool str::operator > (const str & rhs) const
+void str_array::grow_chars(const int chars_needed)
 {
-    return str::compare(c_str(), rhs.c_str()) > 0;
+    int new_capacity = (m_chars_capacity > 0 ? m_chars_capacity * 2 : 4096);
+    if (new_capacity < chars_needed)
+    {
+        new_capacity = chars_needed;
+    }
+
+    m_chars = str_array_realloc(m_chars, m_chars_capacity, new_capacity);
+    STR_ASSERT(m_chars != nullptr);
+    m_chars_capacity = new_capacity;
 }
 
-inline bool str::operator < (const str & rhs) const
+void str_array::grow_offsets()
 {
-    return str::compare(c_str(), rhs.c_str()) < 0;
+    const int new_capacity = (m_offsets_capacity > 0 ? m_offsets_capacity * 2 : 256);
+
+    m_offsets = reinterpret_cast<int *>(str_array_realloc(
+        reinterpret_cast<char *>(m_offsets),
+        m_offsets_capacity * static_cast<int>(sizeof(int)),
+        new_capacity * static_cast<int>(sizeof(int))));
+    STR_ASSERT(m_offsets != nullptr);
+    m_offsets_capacity = new_capacity;
 }
 
-inline bool str::operator == (const char * rhs) const
+char * str_builder::scratch_alloc(const int size_in_bytes)
 {
-    return str::compare(c_str(), rhs) == 0;
+    STR_ASSERT(size_in_bytes > 0 && size_in_bytes <= static_cast<int>(sizeof(scratch_block::data)));
+
+    scratch_block * b = m_scratch_list;
+    if (b == nullptr || (static_cast<int>(sizeof(b->data)) - b->used) < size_in_bytes)
+    {
+        b = reinterpret_cast<scratch_block *>(STR_MEM_ALLOC(sizeof(scratch_block)));
+        STR_ASSERT(b != nullptr);
+
+        b->next = m_scratch_list;
+        b->used = 0;
+        m_scratch_list = b;
+    }
+
+    char * ptr = b->data + b->used;
+    b->used += size_in_bytes;
+    return ptr;
 }
 
-inline bool str::operator != (const char * rhs) const
+// ========================================================
+// namespace str_bulk implementation:
+// ========================================================
+
+namespace str_bulk
 {
-    return str::compare(c_str(), rhs) != 0;
-}
 
-inline bool str::operator <= (const char * rhs) const
+void to_lower(str * begin, str * end, const int thread_count)
 {
-    return str::compare(c_str(), rhs) <= 0;
+    for_each(begin, end, thread_count, [](str & s) { s.to_lower(); });
 }
 
-inline bool str::operator >= (const char * rhs) const
+void to_upper(str * begin, str * end, const int thread_count)
 {
-    return str::compare(c_str(), rhs) >= 0;
+    for_each(begin, end, thread_count, [](str & s) { s.to_upper(); });
 }
 
-inline bool str::operator > (const char * rhs) const
+void trim(str * begin, str * end, const int thread_count)
 {
-    return str::compare(c_str(), rhs) > 0;
+    for_each(begin, end, thread_count, [](str & s) { s.trim(); });
 }
 
-inline bool str::operator < (const char * rhs) const
+int find_first(const str * begin, const str * end, const char * substring, const int thread_count)
 {
-    return str::compare(c_str(), rhs) < 0;
+    STR_ASSERT(substring != nullptr);
+
+    // One result slot per shard, padded out to a cache line so the
+    // workers' writes don't false-share.
+    struct result_slot
+    {
+        int  first_match;
+        char padding[60];
+    };
+
+    result_slot results[max_thread_count];
+    for (int i = 0; i < max_thread_count; ++i)
+    {
+        results[i].first_match = -1;
+    }
+
+    parallel_shards(begin, end, thread_count,
+                    [&results, begin, substring](const str * first, const str * last, const int shard_index)
+    {
+        for (const str * s = first; s != last; ++s)
+        {
+            if (s->first_index_of(substring) >= 0)
+            {
+                results[shard_index].first_match = static_cast<int>(s - begin);
+                return; // Anything further along this shard can't be first.
+            }
+        }
+    });
+
+    // The shards cover the array in order, so the lowest shard
+    // with a match holds the overall first index.
+    for (int i = 0; i < max_thread_count; ++i)
+    {
+        if (results[i].first_match >= 0)
+        {
+            return results[i].first_match;
+        }
+    }
+    return -1;
 }
 
-inline bool str::operator == (const std::string & rhs) const
+} // namespace str_bulk {}
+
+// ========================================================
+// swap(str&, str&):
+// ========================================================
+
+void swap(str & lhs, str & rhs) noexcept
 {
-    return str::compare(c_str(), rhs.c_str()) == 0;
+#define STR_SWAP(a, b) \
+    do {               \
+        auto tmp{ b }; \
+        b = a;         \
+        a = tmp;       \
+    } while (0,0)
+
+    if (lhs.using_local_buffer() || rhs.using_local_buffer())
+    {
+        // Not safe to swap m_data pointer if either is pointing
+        // to the inline data buffer of a str_sized. In this case
+        // we have to do a normal copied swap.
+        STR_SWAP(lhs, rhs);
+    }
+    else // Lightweight swap:
+    {
+        // std::swap doesn't work here because a reference cannot
+        // bind to a bitfield and some members of str are bitfields.
+        STR_SWAP(lhs.m_data,              rhs.m_data);
+        STR_SWAP(lhs.m_length,            rhs.m_length);
+        STR_SWAP(lhs.m_capacity,          rhs.m_capacity);
+        STR_SWAP(lhs.m_local_buffer_size, rhs.m_local_buffer_size);
+        STR_SWAP(lhs.m_owns_buffer,       rhs.m_owns_buffer);
+    }
+
+#undef STR_SWAP
 }
 
-inline bool str::operator != (const std::string & rhs) const
+// ========================================================
+// class str implementation:
+// ========================================================
+
+str::str() noexcept
+    : m_data{ get_empty_dummy_string() }
+    , m_length{ 0 }
+    , m_capacity{ 0 }
+    , m_local_buffer_size{ 0 }
+    , m_owns_buffer{ false }
 {
-    return str::compare(c_str(), rhs.c_str()) != 0;
 }
 
-inline bool str::operator <= (const std::string & rhs) const
+str::str(const int local_buf_size)
+    : m_data{ get_local_buffer() }
+    , m_length{ 0 }
+    , m_capacity{ static_cast<std::uint32_t>(local_buf_size) }
+    , m_local_buffer_size{ static_cast<std::uint32_t>(local_buf_size) }
+    , m_owns_buffer{ true }
 {
-    return str::compare(c_str(), rhs.c_str()) <= 0;
+    // Already static_asserted in str_sized, but doesn't harm to check again...
+    STR_ASSERT(local_buf_size < 1024);
+    m_data[0] = '\0';
 }
 
-inline bool str::operator >= (const std::string & rhs) const
+str::~str()
 {
-    return str::compare(c_str(), rhs.c_str()) >= 0;
+    if (m_owns_buffer && !using_local_buffer())
+    {
+        free_heap_buffer();
+    }
 }
 
-inline bool str::operator > (const std::string & rhs) const
+char * str::get_empty_dummy_string() const noexcept
 {
-    return str::compare(c_str(), rhs.c_str()) > 0;
+    // Used by the default constructor, which creates a valid but empty string.
+    // ISO C++11 does not allow conversion from string literal to char*, so
+    // this function prevents a warning on Clang/GCC. As long as we play nice
+    // and don't attempt to mutate this string, everything will work fine.
+    static char s_dummy[] = {'\0','\0','\0','\0'};
+    return s_dummy;
 }
 
-inline bool str::operator < (const std::string & rhs) const
+void str::set(const char * src, const int first, const int count)
 {
-    return str::compare(c_str(), rhs.c_str()) < 0;
+    STR_ASSERT(src != nullptr);
+    STR_ASSERT(first >= 0);
+    STR_ASSERT(count >= 0);
+
+    src += first;
+
+    // Calling str.set("") makes the string empty. The explicit count
+    // is honored as-is otherwise - interior null bytes are data, so
+    // binary payloads round-trip through here unharmed.
+    if (count == 0)
+    {
+        clear_no_free();
+        return;
+    }
+
+    const int chars_needed = count + 1;
+    if (capacity() < chars_needed)
+    {
+        reserve_discard(chars_needed);
+    }
+
+    std::memcpy(m_data, src, count);
+
+    m_data[count] = '\0';
+    m_length      = count;
+    m_owns_buffer = true;
 }
 
-inline void str::set(const str & src)
+void str::set_ref(const char * src, const int first)
 {
-    set(src.c_str(), 0, src.length());
+    STR_ASSERT(src != nullptr);
+
+    src += first;
+
+    if (*src == '\0')
+    {
+        clear_no_free();
+        return;
+    }
+
+    if (m_owns_buffer && !using_local_buffer())
+    {
+        free_heap_buffer();
+    }
+
+    m_data        = const_cast<char *>(src); // Taken in good faith that the user won't try to modify it!
+    m_length      = str::length(src);
+    m_capacity    = 0;
+    m_owns_buffer = false;
 }
 
-inline void str::set(const str & src, int count)
+void str::set_ref(const char * src, const int first, const int count)
 {
-    set(src.c_str(), 0, count);
+    STR_ASSERT(src != nullptr);
+    STR_ASSERT(first >= 0);
+    STR_ASSERT(count >= 0);
+
+    src += first;
+
+    if (count == 0)
+    {
+        clear_no_free();
+        return;
+    }
+
+    if (m_owns_buffer && !using_local_buffer())
+    {
+        free_heap_buffer();
+    }
+
+    // The caller-provided length is trusted as-is - no strlen scan, so
+    // making a view of a token inside a large buffer is O(1). The view
+    // need not be null-terminated at count chars.
+    m_data        = const_cast<char *>(src); // Taken in good faith that the user won't try to modify it!
+    m_length      = count;
+    m_capacity    = 0;
+    m_owns_buffer = false;
 }
 
-inline void str::set(const str & src, int first, int count)
+void str::append(const char * src, const int first, const int count)
 {
-    set(src.c_str(), first, count);
+    STR_ASSERT(src != nullptr);
+    STR_ASSERT(first >= 0);
+    STR_ASSERT(count >= 0);
+
+    src += first;
+
+    // Like set(), the explicit count wins over any '\0' in the input,
+    // so appending binary data is fine.
+    if (count == 0)
+    {
+        return;
+    }
+
+    reserve_for_append(m_length + count + 1);
+
+    std::memcpy(m_data + m_length, src, count);
+
+    m_length += count;
+    m_data[m_length] = '\0';
 }
 
-inline void str::set(const char * src)
+// Returns true when none of the 8 bytes at ptr has the high bit set.
+static bool str_word_is_ascii(const char * ptr)
 {
-    set(src, 0, str::length(src));
+    std::uint64_t word;
+    std::memcpy(&word, ptr, sizeof(word));
+    return (word & 0x8080808080808080ull) == 0;
 }
 
-inline void str::set(const char * src, int count)
+// Validates one UTF-8 sequence starting at 'bytes' ('remaining' bytes
+// available) and returns its length, or 0 when malformed. Rejects
+// overlong encodings, UTF-16 surrogate halves, code points above
+// U+10FFFF and truncated sequences.
+static int str_utf8_sequence(const unsigned char * bytes, const int remaining)
 {
-    set(src, 0, count);
+    const unsigned char lead = bytes[0];
+    if (lead < 0x80)
+    {
+        return 1;
+    }
+    if (lead < 0xC2) // Stray continuation byte, or overlong 2-byte lead (C0/C1).
+    {
+        return 0;
+    }
+    if (lead < 0xE0) // 2-byte sequence.
+    {
+        if (remaining < 2 || (bytes[1] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+        return 2;
+    }
+    if (lead < 0xF0) // 3-byte sequence.
+    {
+        if (remaining < 3 || (bytes[1] & 0xC0) != 0x80 || (bytes[2] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+        if (lead == 0xE0 && bytes[1] < 0xA0) // Overlong.
+        {
+            return 0;
+        }
+        if (lead == 0xED && bytes[1] > 0x9F) // U+D800-U+DFFF surrogate half.
+        {
+            return 0;
+        }
+        return 3;
+    }
+    if (lead < 0xF5) // 4-byte sequence.
+    {
+        if (remaining < 4 || (bytes[1] & 0xC0) != 0x80 || (bytes[2] & 0xC0) != 0x80 || (bytes[3] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+        if (lead == 0xF0 && bytes[1] < 0x90) // Overlong.
+        {
+            return 0;
+        }
+        if (lead == 0xF4 && bytes[1] > 0x8F) // Above U+10FFFF.
+        {
+            return 0;
+        }
+        return 4;
+    }
+    return 0; // F5-FF are never valid lead bytes.
 }
 
-inline void str::set(const std::string & src)
+bool str::append_validated(const char * src, const int count)
 {
-    set(src.c_str(), 0, narrow<int>(src.length()));
+    STR_ASSERT(src != nullptr);
+    STR_ASSERT(count >= 0);
+
+    if (count == 0)
+    {
+        return true;
+    }
+
+    reserve_for_append(m_length + count + 1);
+    char * dest = m_data + m_length;
+
+    // Validate and copy in the same pass: ASCII runs move 8 bytes per
+    // iteration, multi-byte sequences are checked and copied one
+    // sequence at a time. Nothing past the old terminator is committed
+    // until the whole input checked out, so failing halfway leaves the
+    // string untouched.
+    const unsigned char * bytes = reinterpret_cast<const unsigned char *>(src);
+    int i = 0;
+    while (i < count)
+    {
+        while (i + 8 <= count && str_word_is_ascii(src + i))
+        {
+            std::memcpy(dest + i, src + i, 8);
+            i += 8;
+        }
+        if (i >= count)
+        {
+            break;
+        }
+
+        const int sequence_len = str_utf8_sequence(bytes + i, count - i);
+        if (sequence_len == 0)
+        {
+            return false; // m_length and the terminator were never touched.
+        }
+        std::memcpy(dest + i, src + i, sequence_len);
+        i += sequence_len;
+    }
+
+    m_length += count;
+    m_data[m_length] = '\0';
+    return true;
 }
 
-inline void str::set(const std::string & src, int count)
+bool str::starts_with(const char * prefix, const int prefix_len) const
 {
-    set(src.c_str(), 0, count);
-}
+    STR_ASSERT(prefix != nullptr);
+    STR_ASSERT(prefix_len >= 0);
 
-inline void str::set(const std::string & src, int first, int count)
-{
-    set(src.c_str(), first, count);
-}
+    if (m_length == 0 || prefix_len == 0 || m_length < prefix_len)
+    {
+        return false;
+    }
 
-inline void str::set_ref(const str & src)
-{
-    set_ref(src.c_str(), 0);
+    return str::compare(m_data, prefix, prefix_len) == 0;
 }
 
-inline void str::set_ref(const str & src, const int first)
+bool str::ends_with(const char * suffix, const int suffix_len) const
 {
-    STR_ASSERT(first < src.length());
-    set_ref(src.c_str(), first);
-}
+    STR_ASSERT(suffix != nullptr);
+    STR_ASSERT(suffix_len >= 0);
 
-inline void str::set_ref(const char * src)
-{
-    set_ref(src, 0);
-}
+    if (m_length == 0 || suffix_len == 0 || m_length < suffix_len)
+    {
+        return false;
+    }
 
-inline void str::set_ref(const std::string & src)
-{
-    set_ref(src.c_str(), 0);
-}
+    if (m_length == suffix_len)
+    {
+        return str::compare(m_data, suffix) == 0;
+    }
 
-inline void str::set_ref(const std::string & src, const int first)
-{
-    STR_ASSERT(first < narrow<int>(src.length()));
-    set_ref(src.c_str(), first);
+    const char * startPtr = m_data + m_length - suffix_len;
+    return str::compare(startPtr, suffix, suffix_len) == 0;
 }
 
-inline void str::append(const str & src)
+int str::first_index_of(const char c) const
 {
-    append(src.c_str(), 0, src.length());
-}
+    // In case c == '\0' (find the length of the string).
+    if (c == '\0')
+    {
+        return m_length;
+    }
 
-inline void str::append(const str & src, int count)
-{
-    append(src.c_str(), 0, count);
-}
+    // memchr is keyed off the stored length instead of scanning for the
+    // terminator, and most C runtimes vectorize it for large buffers.
+    const void * found = std::memchr(m_data, c, m_length);
+    if (found == nullptr)
+    {
+        return -1; // Not found.
+    }
 
-inline void str::append(const str & src, int first, int count)
-{
-    append(src.c_str(), first, count);
+    return narrow<int>(static_cast<const char *>(found) - m_data);
 }
 
-inline void str::append(const char * src)
+int str::last_index_of(const char c) const
 {
-    append(src, 0, str::length(src));
-}
+    // In case c == '\0' (find the length of the string).
+    if (c == '\0')
+    {
+        return m_length;
+    }
 
-inline void str::append(const char * src, int count)
-{
-    append(src, 0, count);
-}
+    // Walk backwards from the known end - no forward scan
+    // over the whole buffer just to remember the last match.
+    for (int i = m_length - 1; i >= 0; --i)
+    {
+        if (m_data[i] == c)
+        {
+            return i;
+        }
+    }
 
-inline void str::append(const std::string & src)
-{
-    append(src.c_str(), 0, narrow<int>(src.length()));
+    return -1; // Not found.
 }
 
-inline void str::append(const std::string & src, int count)
+int str::first_index_of(const char * substring) const
 {
-    append(src.c_str(), 0, count);
-}
+    STR_ASSERT(substring != nullptr);
+    if (m_length == 0 || *substring == '\0')
+    {
+        return -1;
+    }
 
-inline void str::append(const std::string & src, int first, int count)
-{
-    append(src.c_str(), first, count);
-}
+    const int substr_len = str::length(substring);
+    if (substr_len > m_length)
+    {
+        return -1;
+    }
 
-inline int str::compare(const str & rhs) const
-{
-    return str::compare(c_str(), rhs.c_str());
-}
+    // Let memchr skip ahead to each candidate first byte, then verify
+    // the candidate with a single memcmp of the known substring length.
+    const char first_char = *substring;
+    const char * ptr      = m_data;
+    const char * last_candidate = m_data + (m_length - substr_len);
 
-inline int str::compare(const char * rhs) const
-{
-    return str::compare(c_str(), rhs);
-}
+    while (ptr <= last_candidate)
+    {
+        const void * found = std::memchr(ptr, first_char, (last_candidate - ptr) + 1);
+        if (found == nullptr)
+        {
+            break;
+        }
 
-inline int str::compare(const std::string & rhs) const
-{
-    return str::compare(c_str(), rhs.c_str());
-}
+        ptr = static_cast<const char *>(found);
+        if (std::memcmp(ptr, substring, substr_len) == 0)
+        {
+            return narrow<int>(ptr - m_data);
+        }
+        ++ptr;
+    }
 
-inline int str::compare_no_case(const str & rhs) const
-{
-    return str::compare_no_case(c_str(), rhs.c_str());
+    return -1; // Not found.
 }
 
-inline int str::compare_no_case(const char * rhs) const
+int str::last_index_of(const char * substring) const
 {
-    return str::compare_no_case(c_str(), rhs);
-}
+    STR_ASSERT(substring != nullptr);
+    if (m_length == 0 || *substring == '\0')
+    {
+        return -1;
+    }
 
-inline int str::compare_no_case(const std::string & rhs) const
-{
-    return str::compare_no_case(c_str(), rhs.c_str());
-}
+    const int substr_len = str::length(substring);
+    if (substr_len > m_length)
+    {
+        return -1;
+    }
 
-inline bool str::starts_with(const str & prefix) const
-{
-    return starts_with(prefix.c_str(), prefix.length());
-}
+    // Check candidates backwards from the known end so we can stop
+    // at the first (i.e. last) match instead of scanning everything.
+    const char first_char = *substring;
 
-inline bool str::starts_with(const char * prefix) const
-{
-    return starts_with(prefix, str::length(prefix));
-}
+    for (int i = m_length - substr_len; i >= 0; --i)
+    {
+        if (m_data[i] == first_char && std::memcmp(m_data + i, substring, substr_len) == 0)
+        {
+            return i;
+        }
+    }
 
-inline bool str::starts_with(const std::string & prefix) const
-{
-    return starts_with(prefix.c_str(), narrow<int>(prefix.length()));
+    return -1; // Not found.
 }
 
-inline bool str::ends_with(const str & suffix) const
+int str::find_any_matching_index(const char * charset) const
 {
-    return ends_with(suffix.c_str(), suffix.length());
-}
+    STR_ASSERT(charset != nullptr);
+    if (m_length == 0 || *charset == '\0')
+    {
+        return -1;
+    }
 
-inline bool str::ends_with(const char * suffix) const
-{
-    return ends_with(suffix, str::length(suffix));
-}
+    // Build a 256-entry membership table once, then the scan is a
+    // single table lookup per byte instead of a nested charset walk.
+    bool charset_table[256] = {};
+    for (const char * set_ptr = charset; *set_ptr != '\0'; ++set_ptr)
+    {
+        charset_table[static_cast<unsigned char>(*set_ptr)] = true;
+    }
 
-inline bool str::ends_with(const std::string & suffix) const
-{
-    return ends_with(suffix.c_str(), narrow<int>(suffix.length()));
-}
+    for (int i = 0; i < m_length; ++i)
+    {
+        if (charset_table[static_cast<unsigned char>(m_data[i])])
+        {
+            return i;
+        }
+    }
 
-inline int str::length(const char * str)
-{
-    STR_ASSERT(str != nullptr);
-    return narrow<int>(std::strlen(str)); // Don't care about 32/64-bits truncation.
+    return -1; // Not found.
 }
 
-inline int str::compare(const char * a, const char * b)
+// ASCII whitespace membership table used by the trim functions and
+// skip_leading_whitespace(). One unconditional load per byte instead
+// of a locale-aware std::isspace() call; marks the same characters
+// isspace() does in the C locale (' ', '\t', '\n', '\v', '\f', '\r').
+static const bool s_str_is_space[256] =
 {
-    STR_ASSERT(a != nullptr);
-    STR_ASSERT(b != nullptr);
+    false, false, false, false, false, false, false, false, false, true,  true,  true,  true,  true,  false, false,
+    false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false,
+    true,  false, false, false, false, false, false, false, false, false, false, false, false, false, false, false
+    // Indices 0x30 - 0xFF zero-initialize to false.
+};
 
-    return std::strcmp(a, b);
+static inline bool str_is_space(const char c)
+{
+    return s_str_is_space[static_cast<unsigned char>(c)];
 }
 
-inline int str::compare(const char * a, const char * b, const int chars_to_compare)
+str & str::trim_right()
 {
-    STR_ASSERT(a != nullptr);
-    STR_ASSERT(b != nullptr);
+    if (m_length == 0)
+    {
+        return *this;
+    }
 
-    return std::strncmp(a, b, chars_to_compare);
-}
+    // Walk back over trailing whitespace with one table load per byte,
+    // then store the terminator once at the new end - no write per
+    // trimmed character.
+    int new_len = m_length;
+    while (new_len != 0 && str_is_space(m_data[new_len - 1]))
+    {
+        --new_len;
+    }
 
-inline int str::append(char * dest, const int dest_size_in_chars, const char * source)
-{
-    return append(dest, dest_size_in_chars, source, str::length(source));
+    m_data[new_len] = '\0';
+    m_length = new_len;
+    return *this;
 }
 
-inline int str::length() const noexcept
+str & str::trim_left()
 {
-    return m_length;
-}
+    if (m_length == 0)
+    {
+        return *this;
+    }
 
-inline int str::capacity() const noexcept
-{
-    return static_cast<int>(m_capacity);
-}
+    int new_len = m_length;
+    char * ptr  = str::skip_leading_whitespace(m_data);
 
-inline int str::local_buffer_size() const noexcept
-{
-    return static_cast<int>(m_local_buffer_size);
-}
+    const int displacement = narrow<int>(ptr - m_data);
+    if (displacement > 0) // Any white space to the left?
+    {
+        new_len -= displacement;
+        if (new_len != 0)
+        {
+            std::memmove(m_data, ptr, new_len);
+        }
 
-inline bool str::empty() const noexcept
-{
-    return m_length == 0;
-}
+        m_data[new_len] = '\0';
+        m_length = new_len;
+    }
 
-inline bool str::valid() const noexcept
-{
-    return m_data != get_empty_dummy_string() && m_length != 0;
+    return *this;
 }
 
-inline bool str::owns_buffer() const noexcept
+str & str::trim()
 {
-    return !!m_owns_buffer; // Double NOT to silence conversion from integer=>bool warning.
+    trim_right();
+    trim_left();
+    return *this;
 }
 
-inline bool str::using_local_buffer() const noexcept
+str & str::insert(const int index, const char * src)
 {
-    return m_data == get_local_buffer() && local_buffer_size() > 0;
+    STR_ASSERT(src != nullptr);
+    return insert(index, src, str::length(src));
 }
 
-inline const char * str::c_str() const noexcept
+str & str::insert(const int index, const str & src)
 {
-    return m_data;
+    return insert(index, src.c_str(), src.length());
 }
 
-inline const char * str::data() const noexcept
+str & str::insert(const int index, const std::string & src)
 {
-    return m_data;
+    return insert(index, src.c_str(), narrow<int>(src.length()));
 }
 
-inline std::string str::std_str() const
+str & str::insert(const int index, const char * src, const int count)
 {
-    return m_data;
-}
+    STR_ASSERT(src != nullptr);
+    STR_ASSERT(count >= 0);
+    STR_ASSERT(index >= 0 && index <= m_length);
 
-inline char * str::get_local_buffer() const noexcept
-{
-    // NOTE: The local buffer is assumed to be whatever follows the class instance.
-    // This is somewhat hackish and potentially fragile, but avoids the need for a
-    // virtual function or a fully templated string class. As long as the layout of
-    // str remains simple (no virtual inheritance), this should work fine.
-    auto base = const_cast<str *>(this);
-    return reinterpret_cast<char *>(base) + sizeof(str);
+    if (count == 0)
+    {
+        return *this;
+    }
+
+    const int new_len = m_length + count;
+    reserve_for_append(new_len + 1);
+
+    // A single memmove opens the gap (terminator rides along with
+    // the tail), then the new characters drop straight into it.
+    std::memmove(m_data + index + count, m_data + index, (m_length - index) + 1);
+    std::memcpy(m_data + index, src, count);
+
+    m_length = new_len;
+    return *this;
 }
 
-inline void str::clear_no_free() noexcept
+str & str::erase(const int first, const int count)
 {
-    if (m_data != get_empty_dummy_string())
+    STR_ASSERT(first >= 0 && first <= m_length);
+    STR_ASSERT(count >= 0 && (first + count) <= m_length);
+
+    if (count == 0)
     {
-        m_data[0] = '\0';
-        m_length  = 0;
+        return *this;
     }
+
+    // One memmove pulls the tail (and terminator) left over the gap.
+    std::memmove(m_data + first, m_data + first + count, (m_length - first - count) + 1);
+
+    m_length -= count;
+    return *this;
 }
 
-inline void str::push_back(const char c)
+str & str::replace_all(const char from, const char to)
 {
-    reserve(m_length + 2);
-    m_data[m_length++] = c;
-    m_data[m_length  ] = '\0';
+    STR_ASSERT(from != '\0');
+    STR_ASSERT(to   != '\0');
+
+    // memchr hops between matches, so strings without 'from' cost
+    // a single vectorized scan and no per-byte branching.
+    char * ptr = m_data;
+    const char * const end = m_data + m_length;
+
+    while ((ptr = static_cast<char *>(std::memchr(ptr, from, end - ptr))) != nullptr)
+    {
+        *ptr++ = to;
+    }
+
+    return *this;
 }
 
-inline void str::pop_back()
+str & str::remove_all(const char c)
 {
-    if (m_length > 0)
+    STR_ASSERT(c != '\0');
+
+    // Nothing moves until the first match, so strings without 'c'
+    // are a single memchr scan with no writes.
+    void * found = std::memchr(m_data, c, m_length);
+    if (found == nullptr)
     {
-        m_data[--m_length] = '\0';
+        return *this;
     }
-}
 
-// ================== End of header file ==================
-#endif // STR_HPP
-// ================== End of header file ==================
+    char * write_ptr = static_cast<char *>(found);
+    const char * read_ptr = write_ptr + 1;
+    const char * const end = m_data + m_length;
 
-// ================================================================================================
-//
-//                                     Str Implementation
-//
-// ================================================================================================
+    for (; read_ptr < end; ++read_ptr)
+    {
+        if (*read_ptr != c)
+        {
+            *write_ptr++ = *read_ptr;
+        }
+    }
 
-#ifdef STR_IMPLEMENTATION
+    *write_ptr = '\0';
+    m_length = narrow<int>(write_ptr - m_data);
+    return *this;
+}
 
-// 12 bytes on a 32bits machine, 16 on 64bits.
-static_assert(sizeof(str) == (sizeof(char *) == 4 ? 12 : 16), "size of str class should not be greater than 16 bytes!");
+str & str::replace_all(const char * from, const char * to)
+{
+    STR_ASSERT(from != nullptr);
+    STR_ASSERT(to   != nullptr);
+    STR_ASSERT(*from != '\0'); // Replacing the empty string is not meaningful.
 
-// Need to maintain plain data layout for str::get_local_buffer() to work.
-static_assert(!std::is_polymorphic<str>::value, "str class will not work with virtual inheritance!");
+    const int from_len = str::length(from);
+    const int to_len   = str::length(to);
 
-// Assert we don't have any unexpected padding:
-#ifndef STR_SIZED_NO_GLOBAL_ALIASES
-    static_assert(sizeof(str16)  == sizeof(str) + 16,  "unexpected size!");
-    static_assert(sizeof(str32)  == sizeof(str) + 32,  "unexpected size!");
-    static_assert(sizeof(str64)  == sizeof(str) + 64,  "unexpected size!");
-    static_assert(sizeof(str128) == sizeof(str) + 128, "unexpected size!");
-    static_assert(sizeof(str256) == sizeof(str) + 256, "unexpected size!");
-    static_assert(sizeof(str512) == sizeof(str) + 512, "unexpected size!");
-#endif // STR_SIZED_NO_GLOBAL_ALIASES
+    if (from_len > m_length)
+    {
+        return *this;
+    }
 
-// On some platform vsnprintf() takes va_list by reference and modifies it.
-// va_copy is the 'correct' way to copy a va_list but Visual Studio prior to 2013 doesn't have it.
-#if (defined(_MSC_VER) && (_MSC_VER <= 1700))
-    #ifndef va_copy
-        #define va_copy(dest, src) (dest = src)
-    #endif // va_copy
-#endif // _MSC_VER
+    // Counting pre-pass: occurrences are matched non-overlapping, left to
+    // right, with the same memchr-driven scan first_index_of() uses. Knowing
+    // the count up front lets the output pass below do at most one reserve
+    // and move every byte exactly once.
+    const char first_char = *from;
+    const char * const last_candidate = m_data + (m_length - from_len);
 
-// ========================================================
-// swap(str&, str&):
-// ========================================================
+    int match_count = 0;
+    for (const char * ptr = m_data; ptr <= last_candidate;)
+    {
+        const void * found = std::memchr(ptr, first_char, (last_candidate - ptr) + 1);
+        if (found == nullptr)
+        {
+            break;
+        }
 
-void swap(str & lhs, str & rhs) noexcept
-{
-#define STR_SWAP(a, b) \
-    do {               \
-        auto tmp{ b }; \
-        b = a;         \
-        a = tmp;       \
-    } while (0,0)
+        ptr = static_cast<const char *>(found);
+        if (std::memcmp(ptr, from, from_len) == 0)
+        {
+            ++match_count;
+            ptr += from_len;
+        }
+        else
+        {
+            ++ptr;
+        }
+    }
 
-    if (lhs.using_local_buffer() || rhs.using_local_buffer())
+    if (match_count == 0)
     {
-        // Not safe to swap m_data pointer if either is pointing
-        // to the inline data buffer of a str_sized. In this case
-        // we have to do a normal copied swap.
-        STR_SWAP(lhs, rhs);
+        return *this;
     }
-    else // Lightweight swap:
+
+    const int new_len = m_length + match_count * (to_len - from_len);
+
+    if (to_len <= from_len)
     {
-        // std::swap doesn't work here because a reference cannot
-        // bind to a bitfield and some members of str are bitfields.
-        STR_SWAP(lhs.m_data,              rhs.m_data);
-        STR_SWAP(lhs.m_length,            rhs.m_length);
-        STR_SWAP(lhs.m_capacity,          rhs.m_capacity);
-        STR_SWAP(lhs.m_local_buffer_size, rhs.m_local_buffer_size);
-        STR_SWAP(lhs.m_owns_buffer,       rhs.m_owns_buffer);
+        // Shrinking (or same-size): one forward pass with read/write
+        // cursors compacts the string in place - no allocation at all.
+        char * write_ptr = m_data;
+        const char * read_ptr = m_data;
+        const char * const end = m_data + m_length;
+
+        while (read_ptr < end)
+        {
+            if (read_ptr <= last_candidate && *read_ptr == first_char &&
+                std::memcmp(read_ptr, from, from_len) == 0)
+            {
+                std::memcpy(write_ptr, to, to_len);
+                write_ptr += to_len;
+                read_ptr  += from_len;
+            }
+            else
+            {
+                *write_ptr++ = *read_ptr++;
+            }
+        }
+
+        *write_ptr = '\0';
     }
+    else
+    {
+        // Growing: reserve the final size once, then fill backwards from
+        // the end so each byte moves exactly once and no source byte is
+        // overwritten before it has been read. The fill must replace the
+        // same occurrences the counting pass found - a backward rescan
+        // can pick different ones for self-overlapping patterns ("aa"
+        // in "aaa") - so the offsets are recorded forward first, before
+        // the reserve can move the buffer.
+        int local_offsets[64]; // Plenty for typical inputs; larger counts go to the heap.
+        int * match_offsets = local_offsets;
+        if (match_count > 64)
+        {
+            match_offsets = reinterpret_cast<int *>(mem_alloc(match_count * static_cast<int>(sizeof(int))));
+            STR_ASSERT(match_offsets != nullptr);
+        }
 
-#undef STR_SWAP
+        int found = 0;
+        for (const char * ptr = m_data; found < match_count;)
+        {
+            const void * candidate = std::memchr(ptr, first_char, (last_candidate - ptr) + 1);
+            STR_ASSERT(candidate != nullptr); // The counting pass guarantees the matches.
+
+            ptr = static_cast<const char *>(candidate);
+            if (std::memcmp(ptr, from, from_len) == 0)
+            {
+                match_offsets[found++] = narrow<int>(ptr - m_data);
+                ptr += from_len;
+            }
+            else
+            {
+                ++ptr;
+            }
+        }
+
+        reserve(new_len + 1, 0);
+
+        const char * read_ptr = m_data + m_length;
+        char * write_ptr = m_data + new_len;
+        *write_ptr = '\0';
+
+        for (int m = match_count - 1; m >= 0; --m)
+        {
+            const int i = match_offsets[m];
+            const char * const seg_start = m_data + i + from_len;
+            const int seg_len = narrow<int>(read_ptr - seg_start);
+
+            write_ptr -= seg_len;
+            std::memmove(write_ptr, seg_start, seg_len);
+
+            write_ptr -= to_len;
+            std::memcpy(write_ptr, to, to_len);
+
+            read_ptr = m_data + i;
+        }
+        // Bytes before the first match are already in place.
+
+        if (match_offsets != local_offsets)
+        {
+            mem_free(reinterpret_cast<char *>(match_offsets));
+        }
+    }
+
+    m_length = new_len;
+    return *this;
 }
 
-// ========================================================
-// class str implementation:
-// ========================================================
+str & str::to_upper()
+{
+    // Branchless ASCII range check, no locale calls and no terminator
+    // scan - the loop body is straight-line so compilers vectorize it.
+    char * ptr = m_data;
+    const int len = m_length;
 
-str::str() noexcept
-    : m_data{ get_empty_dummy_string() }
-    , m_length{ 0 }
-    , m_capacity{ 0 }
-    , m_local_buffer_size{ 0 }
-    , m_owns_buffer{ false }
+    for (int i = 0; i < len; ++i)
+    {
+        const char c = ptr[i];
+        ptr[i] = static_cast<char>(c - (((c >= 'a') & (c <= 'z')) << 5));
+    }
+    return *this;
+}
+
+str & str::to_lower()
 {
+    char * ptr = m_data;
+    const int len = m_length;
+
+    for (int i = 0; i < len; ++i)
+    {
+        const char c = ptr[i];
+        ptr[i] = static_cast<char>(c + (((c >= 'A') & (c <= 'Z')) << 5));
+    }
+    return *this;
 }
 
-str::str(const int local_buf_size)
-    : m_data{ get_local_buffer() }
-    , m_length{ 0 }
-    , m_capacity{ static_cast<std::uint32_t>(local_buf_size) }
-    , m_local_buffer_size{ static_cast<std::uint32_t>(local_buf_size) }
-    , m_owns_buffer{ true }
+str & str::to_upper_locale()
 {
-    // Already static_asserted in str_sized, but doesn't harm to check again...
-    STR_ASSERT(local_buf_size < 1024);
-    m_data[0] = '\0';
+    for (char * ptr = m_data; *ptr != '\0'; ++ptr)
+    {
+        *ptr = static_cast<char>(std::toupper(*ptr));
+    }
+    return *this;
 }
 
-str::~str()
+str & str::to_lower_locale()
 {
-    if (m_owns_buffer && !using_local_buffer())
+    for (char * ptr = m_data; *ptr != '\0'; ++ptr)
     {
-        STR_ASSERT(m_data != get_empty_dummy_string());
-        STR_MEM_FREE(m_data);
+        *ptr = static_cast<char>(std::tolower(*ptr));
     }
+    return *this;
 }
 
-char * str::get_empty_dummy_string() const noexcept
+bool str::setf(const char * fmt, ...)
 {
-    // Used by the default constructor, which creates a valid but empty string.
-    // ISO C++11 does not allow conversion from string literal to char*, so
-    // this function prevents a warning on Clang/GCC. As long as we play nice
-    // and don't attempt to mutate this string, everything will work fine.
-    static char s_dummy[] = {'\0','\0','\0','\0'};
-    return s_dummy;
+    STR_ASSERT(fmt != nullptr);
+
+    va_list args;
+
+    va_start(args, fmt);
+    const bool result = setfv(fmt, args);
+    va_end(args);
+
+    return result;
 }
 
-void str::set(const char * src, const int first, const int count)
+bool str::setf_no_grow(const char * fmt, ...)
 {
-    STR_ASSERT(src != nullptr);
-    STR_ASSERT(first >= 0);
-    STR_ASSERT(count >= 0);
+    STR_ASSERT(fmt != nullptr);
 
-    src += first;
+    va_list args;
+
+    va_start(args, fmt);
+    const bool result = setfv_no_grow(fmt, args);
+    va_end(args);
+
+    return result;
+}
+
+bool str::setfv(const char * fmt, va_list args)
+{
+    STR_ASSERT(fmt != nullptr);
+
+    // Needed for portability on platforms where va_list
+    // are passed by reference and modified by functions.
+    va_list args2;
+    va_copy(args2, args);
 
-    // Calling str.set("") makes the string empty.
-    if (*src == '\0' || count == 0)
+// MSVC returns -1 on overflow when writing, which forces us to do two passes.
+#ifdef _MSC_VER
+    int result = std::vsnprintf(nullptr, 0, fmt, args);
+    STR_ASSERT(result >= 0);
+    if (capacity() < result + 1)
+    {
+        reserve_discard(result + 1);
+    }
+    result = std::vsnprintf(m_data, result + 1, fmt, args2);
+#else // !_MSC_VER
+    int result = std::vsnprintf(m_owns_buffer ? m_data : nullptr, m_owns_buffer ? capacity() : 0, fmt, args);
+    STR_ASSERT(result >= 0);
+    if (capacity() < result + 1)
     {
-        clear_no_free();
-        return;
+        reserve_discard(result + 1);
+        result = std::vsnprintf(m_data, result + 1, fmt, args2);
     }
+#endif // _MSC_VER
 
-    const int chars_needed = count + 1;
-    if (capacity() < chars_needed)
+    if (result >= 0)
     {
-        reserve_discard(chars_needed);
+        m_length      = result;
+        m_owns_buffer = true;
+        return true;
+    }
+    else
+    {
+        clear_no_free();
+        return false;
     }
-
-    std::memcpy(m_data, src, count);
-
-    m_data[count] = '\0';
-    m_length      = count;
-    m_owns_buffer = true;
 }
 
-void str::set_ref(const char * src, const int first)
+bool str::setfv_no_grow(const char * fmt, va_list args)
 {
-    STR_ASSERT(src != nullptr);
-
-    src += first;
+    STR_ASSERT(fmt != nullptr);
 
-    if (*src == '\0')
+    int result = std::vsnprintf(m_data, capacity(), fmt, args);
+    if (result < 0)
     {
         clear_no_free();
-        return;
+        return false;
     }
 
-    if (m_owns_buffer && !using_local_buffer())
+    if (result >= capacity())
     {
-        STR_ASSERT(m_data != get_empty_dummy_string());
-        STR_MEM_FREE(m_data);
+        result = capacity() - 1;
+        // Overflowed the string, but still succeeds.
     }
 
-    m_data        = const_cast<char *>(src); // Taken in good faith that the user won't try to modify it!
-    m_length      = str::length(src);
-    m_capacity    = 0;
-    m_owns_buffer = false;
+    m_data[result] = '\0'; // Ensure null terminated.
+    m_length       = result;
+    m_owns_buffer  = true;
+    return true;
 }
 
-void str::append(const char * src, const int first, const int count)
+bool str::appendf(const char * fmt, ...)
 {
-    STR_ASSERT(src != nullptr);
-    STR_ASSERT(first >= 0);
-    STR_ASSERT(count >= 0);
-
-    src += first;
-
-    if (*src == '\0' || count == 0)
-    {
-        return;
-    }
+    STR_ASSERT(fmt != nullptr);
 
-    const int chars_needed = m_length + count + 1;
-    if (capacity() < chars_needed)
-    {
-        reserve(chars_needed);
-    }
+    va_list args;
 
-    std::memcpy(m_data + m_length, src, count);
+    va_start(args, fmt);
+    const bool result = appendfv(fmt, args);
+    va_end(args);
 
-    m_length += count;
-    m_data[m_length] = '\0';
+    return result;
 }
 
-bool str::starts_with(const char * prefix, const int prefix_len) const
+bool str::appendfv(const char * fmt, va_list args)
 {
-    STR_ASSERT(prefix != nullptr);
-    STR_ASSERT(prefix_len >= 0);
-
-    if (m_length == 0 || prefix_len == 0 || m_length < prefix_len)
-    {
-        return false;
-    }
+    // Needed for portability on platforms where va_list
+    // are passed by reference and modified by functions.
+    va_list args2;
+    va_copy(args2, args);
 
-    return str::compare(m_data, prefix, prefix_len) == 0;
-}
+    const int cur_len = m_length;
 
-bool str::ends_with(const char * suffix, const int suffix_len) const
-{
-    STR_ASSERT(suffix != nullptr);
-    STR_ASSERT(suffix_len >= 0);
+// MSVC returns -1 on overflow when writing, which forces us to do two passes
+#ifdef _MSC_VER
+    int add_len = std::vsnprintf(nullptr, 0, fmt, args);
+    STR_ASSERT(add_len >= 0);
 
-    if (m_length == 0 || suffix_len == 0 || m_length < suffix_len)
-    {
-        return false;
-    }
+    reserve_for_append(cur_len + add_len + 1);
 
-    if (m_length == suffix_len)
+    add_len = std::vsnprintf(m_data + cur_len, add_len + 1, fmt, args2);
+#else // !_MSC_VER
+    int add_len = std::vsnprintf(m_owns_buffer ? m_data + cur_len : nullptr, m_owns_buffer ? capacity() - cur_len : 0, fmt, args);
+    STR_ASSERT(add_len >= 0);
+    if (capacity() < cur_len + add_len + 1)
     {
-        return str::compare(m_data, suffix) == 0;
+        reserve_for_append(cur_len + add_len + 1);
+        add_len = std::vsnprintf(m_data + cur_len, add_len + 1, fmt, args2);
     }
+#endif // _MSC_VER
 
-    const char * startPtr = m_data + m_length - suffix_len;
-    return str::compare(startPtr, suffix, suffix_len) == 0;
+    m_owns_buffer = true;
+    return add_len >= 0;
 }
 
-int str::first_index_of(const char c) const
+// Powers of ten for float formatting/parsing - shared so both
+// directions scale by the exact same constants.
+static const double s_str_pow10[] =
 {
-    int i = 0;
-    const char * ptr = m_data;
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,
+    1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17
+};
 
-    for (; ptr[i] != '\0'; ++i)
+// Two decimal digits per table entry - halves the divisions
+// and stores compared to the classic one-digit-at-a-time itoa.
+static const char s_str_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Formats value into temp (which must hold at least 20 chars) and
+// returns a pointer to the first digit. Digits end at temp + temp_size.
+static char * str_format_uint_digits(char * temp, const int temp_size, unsigned long long value)
+{
+    char * ptr = temp + temp_size;
+
+    while (value >= 100)
     {
-        if (ptr[i] == c)
-        {
-            return i;
-        }
+        const int pair_index = static_cast<int>(value % 100) * 2;
+        value /= 100;
+        *--ptr = s_str_digit_pairs[pair_index + 1];
+        *--ptr = s_str_digit_pairs[pair_index];
     }
 
-    // In case c == '\0' (find the length of the string).
-    if (c == '\0')
+    if (value >= 10)
     {
-        return i;
+        const int pair_index = static_cast<int>(value) * 2;
+        *--ptr = s_str_digit_pairs[pair_index + 1];
+        *--ptr = s_str_digit_pairs[pair_index];
+    }
+    else
+    {
+        *--ptr = static_cast<char>('0' + value);
     }
 
-    return -1; // Not found.
+    return ptr;
 }
 
-int str::last_index_of(const char c) const
+str & str::append_uint(const unsigned long long value)
 {
-    int i            =  0;
-    int last_index   = -1;
-    const char * ptr = m_data;
-
-    for (; ptr[i] != '\0'; ++i)
-    {
-        if (ptr[i] == c)
-        {
-            last_index = i;
-            // Continue till the last occurrence.
-        }
-    }
+    char temp[20]; // Largest uint64 is 20 digits.
+    const char * digits = str_format_uint_digits(temp, sizeof(temp), value);
+    const int digit_count = narrow<int>((temp + sizeof(temp)) - digits);
 
-    // In case c == '\0' (find the length of the string).
-    if (c == '\0')
-    {
-        last_index = i;
-    }
+    reserve_for_append(m_length + digit_count + 1);
+    std::memcpy(m_data + m_length, digits, digit_count);
 
-    return last_index;
+    m_length += digit_count;
+    m_data[m_length] = '\0';
+    m_owns_buffer = true;
+    return *this;
 }
 
-int str::first_index_of(const char * substring) const
+str & str::append_int(const long long value)
 {
-    STR_ASSERT(substring != nullptr);
-    if (m_length == 0 || *substring == '\0')
+    if (value < 0)
     {
-        return -1;
+        // Negate as unsigned so LLONG_MIN doesn't overflow.
+        reserve_for_append(m_length + 2);
+        m_data[m_length++] = '-';
+        m_data[m_length]   = '\0';
+        return append_uint(0ull - static_cast<unsigned long long>(value));
     }
+    return append_uint(static_cast<unsigned long long>(value));
+}
 
-    const int substr_len = str::length(substring);
-    const char * ptr     = m_data;
+str & str::append_padded(const long long value, const int width, const char fill)
+{
+    STR_ASSERT(width >= 0);
 
-    for (int i = 0; *ptr != '\0'; ++i, ++ptr)
-    {
-        if (*ptr == *substring && str::compare(ptr, substring, substr_len) == 0)
-        {
-            return i;
-        }
-    }
+    char temp[20]; // Largest uint64 is 20 digits.
+    const bool negative = (value < 0);
+    const unsigned long long magnitude =
+        (negative ? 0ull - static_cast<unsigned long long>(value)
+                  : static_cast<unsigned long long>(value));
 
-    return -1; // Not found.
-}
+    const char * digits = str_format_uint_digits(temp, sizeof(temp), magnitude);
+    const int digit_count = narrow<int>((temp + sizeof(temp)) - digits);
 
-int str::last_index_of(const char * substring) const
-{
-    STR_ASSERT(substring != nullptr);
-    if (m_length == 0 || *substring == '\0')
-    {
-        return -1;
-    }
+    const int content_len = digit_count + (negative ? 1 : 0);
+    const int pad_count   = (width > content_len) ? (width - content_len) : 0;
 
-    int last_index       = -1;
-    const int substr_len = str::length(substring);
-    const char * ptr     = m_data;
+    reserve_for_append(m_length + content_len + pad_count + 1);
+    char * dest = m_data + m_length;
 
-    for (int i = 0; *ptr != '\0'; ++i, ++ptr)
+    if (fill == '0')
+    {
+        // Zero padding goes between the sign and the digits ("-007"):
+        if (negative)
+        {
+            *dest++ = '-';
+        }
+        std::memset(dest, '0', pad_count);
+        dest += pad_count;
+    }
+    else
     {
-        if (*ptr == *substring && str::compare(ptr, substring, substr_len) == 0)
+        // Any other fill pads in front of the sign ("  -7"):
+        std::memset(dest, fill, pad_count);
+        dest += pad_count;
+        if (negative)
         {
-            last_index = i;
-            // Continue till the last occurrence.
+            *dest++ = '-';
         }
     }
 
-    return last_index;
+    std::memcpy(dest, digits, digit_count);
+
+    m_length += content_len + pad_count;
+    m_data[m_length] = '\0';
+    m_owns_buffer = true;
+    return *this;
 }
 
-int str::find_any_matching_index(const char * charset) const
+str & str::append_hex(const unsigned long long value, const bool uppercase)
 {
-    STR_ASSERT(charset != nullptr);
-    if (m_length == 0 || *charset == '\0')
-    {
-        return -1;
-    }
+    const char * hex_digits = (uppercase ? "0123456789ABCDEF" : "0123456789abcdef");
 
-    const char * start_ptr = m_data;
-    const char * ptr       = m_data;
+    char temp[16]; // Largest uint64 is 16 hex digits.
+    char * ptr = temp + sizeof(temp);
 
-    for (; *ptr != '\0'; ++ptr)
+    unsigned long long v = value;
+    do
     {
-        const char * set_ptr = charset;
-        for (; *set_ptr != '\0'; ++set_ptr)
-        {
-            if (*ptr == *set_ptr)
-            {
-                break;
-            }
-        }
-        if (*set_ptr != '\0')
-        {
-            break;
-        }
-    }
+        *--ptr = hex_digits[v & 0xF];
+        v >>= 4;
+    } while (v != 0);
+
+    const int digit_count = narrow<int>((temp + sizeof(temp)) - ptr);
 
-    const int match_index = narrow<int>(ptr - start_ptr);
-    return (match_index >= m_length ? -1 : match_index);
+    reserve_for_append(m_length + digit_count + 1);
+    std::memcpy(m_data + m_length, ptr, digit_count);
+
+    m_length += digit_count;
+    m_data[m_length] = '\0';
+    m_owns_buffer = true;
+    return *this;
 }
 
-str & str::trim_right()
+str & str::append_float(const double value, const int decimal_digits)
 {
-    if (m_length == 0)
+    STR_ASSERT(decimal_digits >= 0);
+
+    // Fixed-notation fast path for the common magnitude range; NaNs,
+    // infinities, very large values and very high precision fall back
+    // to the printf-based path, which handles every corner case.
+    if (!(value == value) || value >= 1e18 || value <= -1e18 || decimal_digits > 17)
     {
+        appendf("%.*f", decimal_digits, value);
         return *this;
     }
 
-    int new_len = m_length;
-    char * ptr  = m_data + (new_len - 1);
-
-    while (new_len != 0 && std::isspace(*ptr))
+    double v = value;
+    if (v < 0.0 || (v == 0.0 && 1.0 / v < 0.0)) // Preserve -0.0 like printf does.
     {
-        *ptr-- = '\0';
-        --new_len;
+        reserve_for_append(m_length + 2);
+        m_data[m_length++] = '-';
+        m_data[m_length]   = '\0';
+        v = -v;
     }
 
-    m_length = new_len;
-    return *this;
-}
+    const double scale = s_str_pow10[decimal_digits];
 
-str & str::trim_left()
-{
-    if (m_length == 0)
+    unsigned long long int_part = static_cast<unsigned long long>(v);
+    double frac = (v - static_cast<double>(int_part)) * scale;
+
+    // Round half away from zero, carrying into the integer part if needed:
+    unsigned long long frac_part = static_cast<unsigned long long>(frac + 0.5);
+    if (frac_part >= static_cast<unsigned long long>(scale))
     {
-        return *this;
+        frac_part = 0;
+        ++int_part;
     }
 
-    int new_len = m_length;
-    char * ptr  = str::skip_leading_whitespace(m_data);
+    append_uint(int_part);
 
-    const int displacement = narrow<int>(ptr - m_data);
-    if (displacement > 0) // Any white space to the left?
+    if (decimal_digits > 0)
     {
-        new_len -= displacement;
-        if (new_len != 0)
+        char temp[20];
+        const char * digits = str_format_uint_digits(temp, sizeof(temp), frac_part);
+        const int digit_count = narrow<int>((temp + sizeof(temp)) - digits);
+        const int zero_pad    = decimal_digits - digit_count;
+
+        reserve_for_append(m_length + decimal_digits + 2);
+        m_data[m_length++] = '.';
+
+        for (int i = 0; i < zero_pad; ++i)
         {
-            std::memmove(m_data, ptr, new_len);
+            m_data[m_length++] = '0';
         }
 
-        m_data[new_len] = '\0';
-        m_length = new_len;
+        std::memcpy(m_data + m_length, digits, digit_count);
+        m_length += digit_count;
+        m_data[m_length] = '\0';
     }
 
+    m_owns_buffer = true;
     return *this;
 }
 
-str & str::trim()
+str & str::set_int(const long long value)
 {
-    trim_right();
-    trim_left();
-    return *this;
+    clear_no_free();
+    return append_int(value);
 }
 
-str & str::to_upper()
+str & str::set_uint(const unsigned long long value)
 {
-    for (char * ptr = m_data; *ptr != '\0'; ++ptr)
-    {
-        *ptr = static_cast<char>(std::toupper(*ptr));
-    }
-    return *this;
+    clear_no_free();
+    return append_uint(value);
 }
 
-str & str::to_lower()
+str & str::set_hex(const unsigned long long value, const bool uppercase)
 {
-    for (char * ptr = m_data; *ptr != '\0'; ++ptr)
-    {
-        *ptr = static_cast<char>(std::tolower(*ptr));
-    }
-    return *this;
+    clear_no_free();
+    return append_hex(value, uppercase);
 }
 
-bool str::setf(const char * fmt, ...)
+str & str::set_float(const double value, const int decimal_digits)
 {
-    STR_ASSERT(fmt != nullptr);
-
-    va_list args;
-
-    va_start(args, fmt);
-    const bool result = setfv(fmt, args);
-    va_end(args);
-
-    return result;
+    clear_no_free();
+    return append_float(value, decimal_digits);
 }
 
-bool str::setf_no_grow(const char * fmt, ...)
+// Digit-only helper shared by the integer parsers; the sign (and the
+// optional '+' accepted by to_uint) is consumed by the callers.
+static bool str_parse_uint_digits(const char * src, const int len, unsigned long long & out)
 {
-    STR_ASSERT(fmt != nullptr);
+    if (len <= 0)
+    {
+        return false;
+    }
 
-    va_list args;
+    const unsigned long long max_val = ~0ull;
+    unsigned long long value = 0;
 
-    va_start(args, fmt);
-    const bool result = setfv_no_grow(fmt, args);
-    va_end(args);
+    for (int i = 0; i < len; ++i)
+    {
+        const unsigned int digit = static_cast<unsigned int>(static_cast<unsigned char>(src[i])) - '0';
+        if (digit > 9)
+        {
+            return false; // Not a digit - reject the whole input.
+        }
+        if (value > (max_val - digit) / 10)
+        {
+            return false; // Would overflow 64 bits.
+        }
+        value = (value * 10) + digit;
+    }
 
-    return result;
+    out = value;
+    return true;
 }
 
-bool str::setfv(const char * fmt, va_list args)
+bool str::to_uint(const char * src, const int len, unsigned long long & out)
 {
-    STR_ASSERT(fmt != nullptr);
+    STR_ASSERT(src != nullptr || len == 0);
 
-    // Needed for portability on platforms where va_list
-    // are passed by reference and modified by functions.
-    va_list args2;
-    va_copy(args2, args);
+    int start = 0;
+    if (len > 0 && src[0] == '+')
+    {
+        start = 1;
+    }
+    return str_parse_uint_digits(src + start, len - start, out);
+}
 
-// MSVC returns -1 on overflow when writing, which forces us to do two passes.
-#ifdef _MSC_VER
-    int result = std::vsnprintf(nullptr, 0, fmt, args);
-    STR_ASSERT(result >= 0);
-    if (capacity() < result + 1)
+bool str::to_int(const char * src, const int len, long long & out)
+{
+    STR_ASSERT(src != nullptr || len == 0);
+    if (len <= 0)
     {
-        reserve_discard(result + 1);
+        return false;
     }
-    result = std::vsnprintf(m_data, result + 1, fmt, args2);
-#else // !_MSC_VER
-    int result = std::vsnprintf(m_owns_buffer ? m_data : nullptr, m_owns_buffer ? capacity() : 0, fmt, args);
-    STR_ASSERT(result >= 0);
-    if (capacity() < result + 1)
+
+    bool negative = false;
+    int start = 0;
+    if (src[0] == '-')
     {
-        reserve_discard(result + 1);
-        result = std::vsnprintf(m_data, result + 1, fmt, args2);
+        negative = true;
+        start = 1;
+    }
+    else if (src[0] == '+')
+    {
+        start = 1;
     }
-#endif // _MSC_VER
 
-    if (result >= 0)
+    unsigned long long magnitude;
+    if (!str_parse_uint_digits(src + start, len - start, magnitude))
     {
-        m_length      = result;
-        m_owns_buffer = true;
-        return true;
+        return false;
     }
-    else
+
+    // One more value fits on the negative side (two's complement).
+    const unsigned long long limit = (negative ? 0x8000000000000000ull : 0x7FFFFFFFFFFFFFFFull);
+    if (magnitude > limit)
     {
-        clear_no_free();
         return false;
     }
+
+    out = (negative ? static_cast<long long>(0ull - magnitude) : static_cast<long long>(magnitude));
+    return true;
 }
 
-bool str::setfv_no_grow(const char * fmt, va_list args)
+bool str::to_double(const char * src, const int len, double & out)
 {
-    STR_ASSERT(fmt != nullptr);
-
-    int result = std::vsnprintf(m_data, capacity(), fmt, args);
-    if (result < 0)
+    STR_ASSERT(src != nullptr || len == 0);
+    if (len <= 0)
     {
-        clear_no_free();
         return false;
     }
 
-    if (result >= capacity())
+    const char * ptr = src;
+    const char * const end = src + len;
+
+    bool negative = false;
+    if (*ptr == '-' || *ptr == '+')
     {
-        result = capacity() - 1;
-        // Overflowed the string, but still succeeds.
+        negative = (*ptr == '-');
+        ++ptr;
     }
 
-    m_data[result] = '\0'; // Ensure null terminated.
-    m_length       = result;
-    m_owns_buffer  = true;
-    return true;
-}
+    // Accumulate the mantissa as an integer across both sides of the
+    // decimal point, tracking the implied power of ten separately.
+    // Digits beyond 64 bits of mantissa only adjust the scale.
+    unsigned long long mantissa = 0;
+    int exponent     = 0;
+    bool any_digits  = false;
 
-bool str::appendf(const char * fmt, ...)
-{
-    STR_ASSERT(fmt != nullptr);
+    const unsigned long long mantissa_cutoff = (~0ull - 9) / 10;
 
-    va_list args;
+    for (; ptr < end; ++ptr)
+    {
+        const unsigned int digit = static_cast<unsigned int>(static_cast<unsigned char>(*ptr)) - '0';
+        if (digit > 9)
+        {
+            break;
+        }
+        any_digits = true;
 
-    va_start(args, fmt);
-    const bool result = appendfv(fmt, args);
-    va_end(args);
+        if (mantissa <= mantissa_cutoff)
+        {
+            mantissa = (mantissa * 10) + digit;
+        }
+        else
+        {
+            ++exponent; // Beyond double precision anyway - drop it, keep the scale.
+        }
+    }
 
-    return result;
-}
+    if (ptr < end && *ptr == '.')
+    {
+        for (++ptr; ptr < end; ++ptr)
+        {
+            const unsigned int digit = static_cast<unsigned int>(static_cast<unsigned char>(*ptr)) - '0';
+            if (digit > 9)
+            {
+                break;
+            }
+            any_digits = true;
 
-bool str::appendfv(const char * fmt, va_list args)
-{
-    // Needed for portability on platforms where va_list
-    // are passed by reference and modified by functions.
-    va_list args2;
-    va_copy(args2, args);
+            if (mantissa <= mantissa_cutoff)
+            {
+                mantissa = (mantissa * 10) + digit;
+                --exponent;
+            }
+        }
+    }
 
-    const int cur_len = m_length;
+    if (!any_digits)
+    {
+        return false;
+    }
 
-// MSVC returns -1 on overflow when writing, which forces us to do two passes
-#ifdef _MSC_VER
-    int add_len = std::vsnprintf(nullptr, 0, fmt, args);
-    STR_ASSERT(add_len >= 0);
+    if (ptr < end && (*ptr == 'e' || *ptr == 'E'))
+    {
+        ++ptr;
+        bool exp_negative = false;
+        if (ptr < end && (*ptr == '-' || *ptr == '+'))
+        {
+            exp_negative = (*ptr == '-');
+            ++ptr;
+        }
+        if (ptr == end)
+        {
+            return false; // 'e' with no digits after it.
+        }
 
-    if (capacity() < cur_len + add_len + 1)
+        int exp_value = 0;
+        for (; ptr < end; ++ptr)
+        {
+            const unsigned int digit = static_cast<unsigned int>(static_cast<unsigned char>(*ptr)) - '0';
+            if (digit > 9)
+            {
+                return false;
+            }
+            if (exp_value < 100000) // Clamp - already far outside double range.
+            {
+                exp_value = (exp_value * 10) + static_cast<int>(digit);
+            }
+        }
+
+        exponent += (exp_negative ? -exp_value : exp_value);
+    }
+
+    if (ptr != end)
     {
-        reserve(cur_len + add_len + 1);
+        return false; // Trailing garbage.
     }
 
-    add_len = std::vsnprintf(m_data + cur_len, add_len + 1, fmt, args2);
-#else // !_MSC_VER
-    int add_len = std::vsnprintf(m_owns_buffer ? m_data + cur_len : nullptr, m_owns_buffer ? capacity() - cur_len : 0, fmt, args);
-    STR_ASSERT(add_len >= 0);
-    if (capacity() < cur_len + add_len + 1)
+    // Scale by the decimal exponent in table-sized chunks. Magnitudes
+    // outside double range saturate to infinity/zero, like strtod.
+    double value = static_cast<double>(mantissa);
+    while (exponent > 0)
     {
-        reserve(cur_len + add_len + 1);
-        add_len = std::vsnprintf(m_data + cur_len, add_len + 1, fmt, args2);
+        const int step = (exponent < 17 ? exponent : 17);
+        value *= s_str_pow10[step];
+        exponent -= step;
+    }
+    while (exponent < 0 && value != 0.0)
+    {
+        const int step = (exponent > -17 ? -exponent : 17);
+        value /= s_str_pow10[step];
+        exponent += step;
     }
-#endif // _MSC_VER
 
-    m_owns_buffer = true;
-    return add_len >= 0;
+    out = (negative ? -value : value);
+    return true;
+}
+
+bool str::to_float(const char * src, const int len, float & out)
+{
+    double value;
+    if (!to_double(src, len, value))
+    {
+        return false;
+    }
+    out = static_cast<float>(value);
+    return true;
+}
+
+bool str::to_int(long long & out) const
+{
+    return to_int(m_data, m_length, out);
+}
+
+bool str::to_uint(unsigned long long & out) const
+{
+    return to_uint(m_data, m_length, out);
+}
+
+bool str::to_float(float & out) const
+{
+    return to_float(m_data, m_length, out);
+}
+
+bool str::to_double(double & out) const
+{
+    return to_double(m_data, m_length, out);
 }
 
 str & str::truncate(const int max_len)
@@ -1620,8 +5211,7 @@ void str::clear()
 {
     if (m_owns_buffer && !using_local_buffer())
     {
-        STR_ASSERT(m_data != get_empty_dummy_string());
-        STR_MEM_FREE(m_data);
+        free_heap_buffer();
     }
 
     if (local_buffer_size() > 0) // Have a local buffer?
@@ -1654,16 +5244,16 @@ void str::shrink_to_fit()
         return;
     }
 
-    char * new_data = STR_MEM_ALLOC(new_capacity);
-    STR_ASSERT(new_data != nullptr);
-
-    std::memcpy(new_data, m_data, new_capacity);
-
+    // Shrinking can usually be done in place by the allocator. A block
+    // that spilled its capacity into a header keeps the header (and the
+    // sentinel) even when the new size would fit the bitfield again.
     STR_ASSERT(m_data != get_empty_dummy_string());
-    STR_MEM_FREE(m_data);
+    const bool big_format = has_big_capacity();
+    char * new_data = heap_realloc_chars(new_capacity, new_capacity);
+    STR_ASSERT(new_data != nullptr);
 
     m_data     = new_data;
-    m_capacity = new_capacity;
+    m_capacity = (big_format ? big_capacity_sentinel : static_cast<std::uint32_t>(new_capacity));
 }
 
 void str::reserve(int new_capacity, const int dynamic_alloc_extra)
@@ -1675,36 +5265,53 @@ void str::reserve(int new_capacity, const int dynamic_alloc_extra)
         return;
     }
 
+    STR_STATS_INCREMENT(reserve_grows);
+
     // Reserve memory, preserving the current contents of the string buffer.
-    char * new_data;
+    // The copy uses the stored length instead of rescanning for the terminator,
+    // and writes its own terminator rather than copying one: a disowned string
+    // may be a counted set_ref() slice into a larger buffer, where the byte
+    // after m_length is not ours to read.
     if (new_capacity < local_buffer_size())
     {
         // Disowned -> local buffer
-        new_data     = get_local_buffer();
-        new_capacity = local_buffer_size();
-    }
-    else
-    {
-        // Disowned or local buffer -> Heap
-        new_capacity += dynamic_alloc_extra;
-        new_data = STR_MEM_ALLOC(new_capacity);
-        STR_ASSERT(new_data != nullptr);
+        STR_STATS_INCREMENT(local_buffer_grows);
+        char * new_data = get_local_buffer();
+        std::memcpy(new_data, m_data, m_length);
+        new_data[m_length] = '\0';
+
+        m_data        = new_data;
+        m_capacity    = local_buffer_size();
+        m_owns_buffer = true;
+        return;
     }
 
-#ifdef _MSC_VER
-    strcpy_s(new_data, new_capacity, m_data);
-#else // !_MSC_VER
-    std::strcpy(new_data, m_data);
-#endif // MSC_VER
+    // Disowned or local buffer -> Heap
+    new_capacity += dynamic_alloc_extra;
+
+    const bool big_format = (new_capacity >= static_cast<int>(big_capacity_sentinel));
 
     if (m_owns_buffer && !using_local_buffer())
     {
+        // Already heap allocated - let the allocator try to
+        // extend the block in place with no copying at all.
         STR_ASSERT(m_data != get_empty_dummy_string());
-        STR_MEM_FREE(m_data);
+        const bool keep_big = (big_format || has_big_capacity());
+        char * new_data = heap_realloc_chars(m_length + 1, new_capacity);
+        STR_ASSERT(new_data != nullptr);
+
+        m_data     = new_data;
+        m_capacity = (keep_big ? big_capacity_sentinel : static_cast<std::uint32_t>(new_capacity));
+        return;
     }
 
+    char * new_data = heap_alloc_chars(new_capacity);
+    STR_ASSERT(new_data != nullptr);
+    std::memcpy(new_data, m_data, m_length);
+    new_data[m_length] = '\0';
+
     m_data        = new_data;
-    m_capacity    = new_capacity;
+    m_capacity    = (big_format ? big_capacity_sentinel : static_cast<std::uint32_t>(new_capacity));
     m_owns_buffer = true;
 }
 
@@ -1720,15 +5327,17 @@ void str::reserve_discard(int new_capacity, const int dynamic_alloc_extra)
         return;
     }
 
+    STR_STATS_INCREMENT(reserve_discard_grows);
+
     if (m_owns_buffer && !using_local_buffer())
     {
-        STR_ASSERT(m_data != get_empty_dummy_string());
-        STR_MEM_FREE(m_data);
+        free_heap_buffer();
     }
 
     if (new_capacity < local_buffer_size())
     {
         // Disowned -> local buffer
+        STR_STATS_INCREMENT(local_buffer_grows);
         m_data     = get_local_buffer();
         m_capacity = local_buffer_size();
     }
@@ -1736,9 +5345,11 @@ void str::reserve_discard(int new_capacity, const int dynamic_alloc_extra)
     {
         // Disowned or local buffer -> Heap
         new_capacity += dynamic_alloc_extra;
-        m_data = STR_MEM_ALLOC(new_capacity);
+        m_data = heap_alloc_chars(new_capacity);
         STR_ASSERT(m_data != nullptr);
-        m_capacity = new_capacity;
+        m_capacity = (new_capacity >= static_cast<int>(big_capacity_sentinel)
+                        ? big_capacity_sentinel
+                        : static_cast<std::uint32_t>(new_capacity));
     }
 
     // Previous contents are lost.
@@ -1783,6 +5394,92 @@ void str::resize_discard(const int new_len, const char fill_char, const int dyna
     m_data[m_length] = '\0';
 }
 
+// ASCII-only case fold used by the _no_case comparisons below.
+static inline char str_ascii_fold(const char c)
+{
+    return static_cast<char>(c + (((c >= 'A') & (c <= 'Z')) << 5));
+}
+
+int str::compare_no_case(const char * a, const char * b, const int chars_to_compare)
+{
+    STR_ASSERT(a != nullptr);
+    STR_ASSERT(b != nullptr);
+
+    // Bounded ASCII-folding compare; matches _strnicmp/strncasecmp
+    // behavior in the C locale but never consults the locale.
+    for (int i = 0; i < chars_to_compare; ++i)
+    {
+        const int ca = static_cast<unsigned char>(str_ascii_fold(a[i]));
+        const int cb = static_cast<unsigned char>(str_ascii_fold(b[i]));
+
+        if (ca != cb)
+        {
+            return ca - cb;
+        }
+        if (ca == 0) // Both ended early.
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+bool str::starts_with_no_case(const char * prefix, const int prefix_len) const
+{
+    STR_ASSERT(prefix != nullptr);
+    STR_ASSERT(prefix_len >= 0);
+
+    if (m_length == 0 || prefix_len == 0 || m_length < prefix_len)
+    {
+        return false;
+    }
+
+    return str::compare_no_case(m_data, prefix, prefix_len) == 0;
+}
+
+bool str::ends_with_no_case(const char * suffix, const int suffix_len) const
+{
+    STR_ASSERT(suffix != nullptr);
+    STR_ASSERT(suffix_len >= 0);
+
+    if (m_length == 0 || suffix_len == 0 || m_length < suffix_len)
+    {
+        return false;
+    }
+
+    const char * start_ptr = m_data + m_length - suffix_len;
+    return str::compare_no_case(start_ptr, suffix, suffix_len) == 0;
+}
+
+int str::first_index_of_no_case(const char * substring) const
+{
+    STR_ASSERT(substring != nullptr);
+    if (m_length == 0 || *substring == '\0')
+    {
+        return -1;
+    }
+
+    const int substr_len = str::length(substring);
+    if (substr_len > m_length)
+    {
+        return -1;
+    }
+
+    const char first_folded = str_ascii_fold(*substring);
+    const int last_candidate = m_length - substr_len;
+
+    for (int i = 0; i <= last_candidate; ++i)
+    {
+        if (str_ascii_fold(m_data[i]) == first_folded &&
+            str::compare_no_case(m_data + i, substring, substr_len) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1; // Not found.
+}
+
 int str::compare_no_case(const char * a, const char * b)
 {
     STR_ASSERT(a != nullptr);
@@ -1890,7 +5587,8 @@ char * str::to_upper(char * str)
     STR_ASSERT(str != nullptr);
     for (char * ptr = str; *ptr != '\0'; ++ptr)
     {
-        *ptr = static_cast<char>(std::toupper(*ptr));
+        const char c = *ptr;
+        *ptr = static_cast<char>(c - (((c >= 'a') & (c <= 'z')) << 5));
     }
     return str;
 }
@@ -1900,11 +5598,61 @@ char * str::to_lower(char * str)
     STR_ASSERT(str != nullptr);
     for (char * ptr = str; *ptr != '\0'; ++ptr)
     {
-        *ptr = static_cast<char>(std::tolower(*ptr));
+        const char c = *ptr;
+        *ptr = static_cast<char>(c + (((c >= 'A') & (c <= 'Z')) << 5));
     }
     return str;
 }
 
+bool str::is_ascii(const char * str, const int len)
+{
+    STR_ASSERT(str != nullptr);
+    STR_ASSERT(len >= 0);
+
+    std::uint64_t acc = 0;
+    int i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, str + i, sizeof(word));
+        acc |= word;
+    }
+    for (; i < len; ++i)
+    {
+        acc |= static_cast<unsigned char>(str[i]);
+    }
+    return (acc & 0x8080808080808080ull) == 0;
+}
+
+bool str::validate_utf8(const char * str, const int len)
+{
+    STR_ASSERT(str != nullptr);
+    STR_ASSERT(len >= 0);
+
+    const unsigned char * bytes = reinterpret_cast<const unsigned char *>(str);
+    int i = 0;
+    while (i < len)
+    {
+        // Word-at-a-time fast path over ASCII runs:
+        while (i + 8 <= len && str_word_is_ascii(str + i))
+        {
+            i += 8;
+        }
+        if (i >= len)
+        {
+            break;
+        }
+
+        const int sequence_len = str_utf8_sequence(bytes + i, len - i);
+        if (sequence_len == 0)
+        {
+            return false;
+        }
+        i += sequence_len;
+    }
+    return true;
+}
+
 char * str::split(char * str, const char * delimiters, char ** remaining)
 {
     // Similar to std::strtok, but keeps no local state.
@@ -1956,9 +5704,10 @@ char * str::skip_leading_whitespace(char * str)
 {
     STR_ASSERT(str != nullptr);
 
+    // Table-driven (see s_str_is_space) - no locale lookups.
     for (; *str != '\0'; ++str)
     {
-        if (!std::isspace(*str))
+        if (!str_is_space(*str))
         {
             break;
         }
@@ -1973,7 +5722,7 @@ const char * str::skip_leading_whitespace(const char * str)
 
     for (; *str != '\0'; ++str)
     {
-        if (!std::isspace(*str))
+        if (!str_is_space(*str))
         {
             break;
         }
@@ -8,14 +8,47 @@
 // ================================================================================================
 
 #define STR_IMPLEMENTATION
+#define STR_ENABLE_STATS // Whole suite runs with the counting layer (and its size headers) in play.
 #include "str.hpp"
 
 // For printf
 #include <cstdio>
 
+// For the hashing tests
+#include <unordered_map>
+
 namespace unittest
 {
 
+void test_str_hash()
+{
+    const str a{ "the quick brown fox" };
+    const str b{ "the quick brown fox" };
+    const str c{ "the quick brown foX" };
+
+    STR_ASSERT( a.hash() == b.hash() );
+    STR_ASSERT( a.hash() != c.hash() ); // Not guaranteed, but a collision here would be alarming.
+    STR_ASSERT( str::hash("", 0) == str::hash("", 0) );
+    STR_ASSERT( std::hash<str>{}(a) == std::hash<str>{}(b) );
+
+    // A slice hashes the same as an owning copy of the same bytes:
+    const str_ref slice{ "xxthe quick brown foxxx", 2, 19 };
+    STR_ASSERT( slice.hash() == a.hash() );
+
+    // Keys in unordered containers, with heterogeneous C-string lookup:
+    std::unordered_map<str, int, str_hash, str_equal_to> map;
+    map[a] = 1;
+    map[str{ "another key" }] = 2;
+
+    STR_ASSERT( map.size() == 2 );
+    STR_ASSERT( map.find(str{ "the quick brown fox" }) != map.end() );
+    STR_ASSERT( map.find(str{ "no such key" }) == map.end() );
+
+    std::unordered_map<str64, int> sized_map; // Uses the std::hash specialization.
+    sized_map[str64{ "small-key" }] = 3;
+    STR_ASSERT( sized_map.find(str64{ "small-key" })->second == 3 );
+}
+
 void test_str_basics()
 {
     // Test the basic assumptions about size, capacity, etc.
@@ -49,6 +82,13 @@ void test_str_basics()
 
     STR_ASSERT( s == "hello world" );
     STR_ASSERT( s.compare("hello world") == 0 );
+
+    // equals() short-circuits on length before comparing the chars:
+    STR_ASSERT( s.equals(str{ "hello world" })  == true  );
+    STR_ASSERT( s.equals(str{ "hello worlds" }) == false ); // Different lengths
+    STR_ASSERT( s.equals(str{ "hello_world" })  == false ); // Same length, different chars
+    STR_ASSERT( s.equals(std::string{ "hello world" }) == true );
+
     STR_ASSERT( s.compare_no_case("hello world") == 0 );
     STR_ASSERT( s.compare_no_case("HELLO WORLD") == 0 );
     STR_ASSERT( s.compare_no_case("hEllO WorlD") == 0 );
@@ -58,11 +98,47 @@ void test_str_basics()
     STR_ASSERT( s.starts_with("foo")   == false );
     STR_ASSERT( s.ends_with("bar")     == false );
 
+    // str_literal carries its length from the array bound - no strlen:
+    constexpr str_literal hello_lit{ "hello" };
+    constexpr str_literal world_lit{ "world" };
+    static_assert( hello_lit.length() == 5, "length must come from the array bound" );
+    STR_ASSERT( s.starts_with(hello_lit) == true  );
+    STR_ASSERT( s.ends_with(world_lit)   == true  );
+    STR_ASSERT( s.starts_with(world_lit) == false );
+    STR_ASSERT( s.equals(str_literal{ "hello world" }) == true  );
+    STR_ASSERT( s.equals(hello_lit)                    == false ); // Length mismatch, O(1).
+    STR_ASSERT( s.compare(str_literal{ "hello world" }) == 0 );
+
+    str lit_copy;
+    lit_copy.set(hello_lit);
+    lit_copy.append(str_literal{ "!" });
+    STR_ASSERT( lit_copy == "hello!" );
+
+    // Case-insensitive variants - no temporary lowercased copies:
+    STR_ASSERT( s.starts_with_no_case("HeLLo")  == true  );
+    STR_ASSERT( s.starts_with_no_case("HELP")   == false );
+    STR_ASSERT( s.ends_with_no_case("WORLD")    == true  );
+    STR_ASSERT( s.ends_with_no_case("WORLDS")   == false );
+    STR_ASSERT( s.first_index_of_no_case("WoRlD") ==  6 );
+    STR_ASSERT( s.first_index_of_no_case("LO")    ==  3 );
+    STR_ASSERT( s.first_index_of_no_case("nope")  == -1 );
+    STR_ASSERT( str::compare_no_case("abc", "ABD", 2) == 0 );
+    STR_ASSERT( str::compare_no_case("abc", "ABD", 3) <  0 );
+
     STR_ASSERT( s.first_index_of('o') ==  4 ); // First 'o' is in "hello"
     STR_ASSERT( s.first_index_of('X') == -1 ); // No such character
     STR_ASSERT( s.last_index_of('o')  ==  7 ); // Last 'o' is in "world"
     STR_ASSERT( s.last_index_of('X')  == -1 ); // No such character
 
+    STR_ASSERT( s.first_index_of("world") ==  6 );
+    STR_ASSERT( s.first_index_of("lo")    ==  3 );
+    STR_ASSERT( s.first_index_of("worlds and more") == -1 ); // Longer than the string
+    STR_ASSERT( s.last_index_of("o")      ==  7 );
+    STR_ASSERT( s.last_index_of("hello")  ==  0 );
+    STR_ASSERT( s.last_index_of("nope")   == -1 );
+    STR_ASSERT( s.find_any_matching_index("zw") ==  6 ); // 'w' of "world"
+    STR_ASSERT( s.find_any_matching_index("XY") == -1 );
+
     // Now clear and re-validate:
     s.clear();
     STR_ASSERT( s.empty()    == true    );
@@ -119,6 +195,17 @@ void test_str_basics()
     STR_ASSERT( s == "test-123-abcd" );
     STR_ASSERT( s.length() == 13 );
 
+    // Append loops grow the capacity geometrically, leaving slack:
+    for (int i = 0; i < 1000; ++i)
+    {
+        s.push_back('x');
+    }
+    STR_ASSERT( s.length()   == 1013 );
+    STR_ASSERT( s.capacity() >  1014 ); // More than the exact fit.
+    STR_ASSERT( s.starts_with("test-123-abcd") == true );
+    STR_ASSERT( s.ends_with("xxx") == true );
+    s.truncate(13);
+
     // swap:
     str other{ "foobar" };
     swap(other, s);
@@ -136,6 +223,14 @@ void test_str_basics()
     s.trim_right();
     STR_ASSERT( s == "Hello" );
 
+    // The trims recognize exactly the C-locale whitespace set:
+    s = "\v\f\r mid dle \r\f\v";
+    STR_ASSERT( s.trim() == "mid dle" ); // Interior space untouched.
+    s = " \t\n\v\f\r";
+    STR_ASSERT( s.trim().empty() == true ); // All-whitespace collapses.
+    s = "solid";
+    STR_ASSERT( s.trim() == "solid" ); // Nothing to trim.
+
     // Iteration:
     s.setf("%s", "AESTHETICS");
 
@@ -158,12 +253,129 @@ void test_str_basics()
     // Lowercase/uppercase:
     STR_ASSERT( s.to_lower() == "aesthetics" );
     STR_ASSERT( s.to_upper() == "AESTHETICS" );
+    STR_ASSERT( s.to_lower_locale() == "aesthetics" );
+    STR_ASSERT( s.to_upper_locale() == "AESTHETICS" );
+
+    // Case conversion only touches ASCII letters:
+    str mixed{ "a1-B2_\x7F\tz" };
+    STR_ASSERT( mixed.to_upper() == "A1-B2_\x7F\tZ" );
+    STR_ASSERT( mixed.to_lower() == "a1-b2_\x7F\tz" );
 
     // Truncation:
     STR_ASSERT( s.truncate(10) == "AESTHETICS" ); // Already 10 chars, does nothing.
     STR_ASSERT( s.length() == 10 );
     STR_ASSERT( s.truncate(5) == "AESTH" );
     STR_ASSERT( s.length() == 5 );
+
+    // Replace/remove:
+    s = "a-b-c-d";
+    STR_ASSERT( s.replace_all('-', '+') == "a+b+c+d" );
+    STR_ASSERT( s.replace_all('x', '!') == "a+b+c+d" ); // No match, no change.
+    STR_ASSERT( s.remove_all('+')       == "abcd"    );
+    STR_ASSERT( s.length() == 4 );
+
+    // Same-size substring replacement stays in place:
+    s = "one two one two";
+    STR_ASSERT( s.replace_all("two", "SIX") == "one SIX one SIX" );
+
+    // Shrinking replacement compacts in a single pass:
+    STR_ASSERT( s.replace_all("SIX ", "") == "one one SIX" );
+    STR_ASSERT( s.length() == 11 );
+
+    // Growing replacement reserves once and fills backwards:
+    STR_ASSERT( s.replace_all("one", "fourteen") == "fourteen fourteen SIX" );
+    STR_ASSERT( s.length() == 21 );
+    STR_ASSERT( s.replace_all("zero", "x") == "fourteen fourteen SIX" ); // No match.
+
+    // Matches at the very ends and back to back:
+    s = "ababab";
+    STR_ASSERT( s.replace_all("ab", "xyz") == "xyzxyzxyz" );
+    STR_ASSERT( s.replace_all("xyz", "a")  == "aaa"       );
+    STR_ASSERT( s.remove_all('a').empty() == true );
+
+    // Self-overlapping patterns replace the leftmost non-overlapping
+    // occurrences on both the growing and the shrinking path:
+    s = "aaa";
+    STR_ASSERT( s.replace_all("aa", "xxx") == "xxxa" );
+    s = "aaa";
+    STR_ASSERT( s.replace_all("aa", "b") == "ba" );
+    s = "aaaaa";
+    STR_ASSERT( s.replace_all("aa", "xxx") == "xxxxxxa" );
+
+    // Enough matches to push the recorded offsets onto the heap:
+    s.clear_no_free();
+    for (int i = 0; i < 100; ++i)
+    {
+        s += "ab";
+    }
+    s.replace_all("ab", "xyz");
+    STR_ASSERT( s.length() == 300 );
+    STR_ASSERT( s.starts_with("xyzxyz") && s.ends_with("xyz") );
+
+    // Insert/erase:
+    s = "Hed!";
+    STR_ASSERT( s.insert(2, "llo Worl")          == "Hello World!" );
+    STR_ASSERT( s.insert(0, str{ ">> " })        == ">> Hello World!" );
+    STR_ASSERT( s.insert(s.length(), " <<")      == ">> Hello World! <<" );
+    STR_ASSERT( s.insert(2, std::string{ ">" })  == ">>> Hello World! <<" );
+    STR_ASSERT( s.insert(4, "padding-xyz", 0)    == ">>> Hello World! <<" ); // Zero count, no-op.
+
+    STR_ASSERT( s.erase(0, 4)                    == "Hello World! <<" );
+    STR_ASSERT( s.erase(12, 3)                   == "Hello World!" );
+    STR_ASSERT( s.erase(5, 6)                    == "Hello!" );
+    STR_ASSERT( s.erase(3, 0)                    == "Hello!" ); // Zero count, no-op.
+    STR_ASSERT( s.length() == 6 );
+}
+
+void test_str_binary()
+{
+    // Interior null bytes are data when an explicit count is given:
+    const char blob[] = { 'a', 'b', '\0', 'c', 'd' };
+    str s{ blob, 0, 5 };
+    STR_ASSERT( s.length()    == 5    );
+    STR_ASSERT( s[2]          == '\0' );
+    STR_ASSERT( s[3]          == 'c'  );
+    STR_ASSERT( s.c_str()[5]  == '\0' ); // Still terminated for c_str() interop.
+
+    // A leading null must not read as "empty input":
+    str lead;
+    lead.set("\0payload", 0, 8);
+    STR_ASSERT( lead.length() == 8    );
+    STR_ASSERT( lead[0]       == '\0' );
+    STR_ASSERT( lead[1]       == 'p'  );
+
+    // Appends honor the count across nulls too:
+    s.append(blob, 0, 5);
+    STR_ASSERT( s.length() == 10   );
+    STR_ASSERT( s[7]       == '\0' );
+
+    // Copies, comparisons and hashing are all length-driven:
+    const str copy{ s };
+    STR_ASSERT( copy.length() == 10 );
+    STR_ASSERT( copy.equals(s) );
+    STR_ASSERT( copy.hash() == s.hash() );
+
+    str different{ blob, 0, 5 };
+    different.append("\0\0xyz", 0, 5);
+    STR_ASSERT( different.length() == 10 );
+    STR_ASSERT( different.equals(s) == false );
+
+    // insert/erase round-trip through a binary payload:
+    str t{ blob, 0, 5 };
+    t.insert(2, "\0!", 2);
+    STR_ASSERT( t.length() == 7 );
+    STR_ASSERT( t[2] == '\0' && t[3] == '!' );
+    t.erase(2, 2);
+    STR_ASSERT( t.equals(str{ blob, 0, 5 }) );
+
+    // Zero length no longer means invalid - only the lack of storage does:
+    str v;
+    STR_ASSERT( v.valid() == false ); // Default-constructed, no buffer yet.
+    v = "x";
+    STR_ASSERT( v.valid() == true );
+    v.truncate(0);
+    STR_ASSERT( v.empty() == true );
+    STR_ASSERT( v.valid() == true ); // Empty payload in a real buffer.
 }
 
 void test_str_ref()
@@ -181,6 +393,33 @@ void test_str_ref()
     STR_ASSERT( s == s2 );
     STR_ASSERT( s.compare(s2) == 0 );
     STR_ASSERT( s.compare_no_case(s2) == 0 );
+
+    // Bounded slices trust the caller length - no strlen, no scan:
+    const str_ref world{ "Hello World!", 6, 5 };
+    STR_ASSERT( world.length()      == 5       );
+    STR_ASSERT( world.owns_buffer() == false   );
+    STR_ASSERT( world.equals("World", 5) == true );
+    STR_ASSERT( world == str{ "World" } );
+
+    const str_ref hello = s2.substr_ref(0, 5);
+    STR_ASSERT( hello.length() == 5 );
+    STR_ASSERT( hello.data()   == s2.data() ); // Points into s2, zero-copy.
+    STR_ASSERT( hello == str{ "Hello" } );
+
+    // A whole-string slice is still a proper C string:
+    const str_ref whole = s2.substr_ref(0, s2.length());
+    STR_ASSERT( whole == s2 );
+
+    // Growing a slice of an unterminated exact-size buffer must copy
+    // only length() bytes - one past the slice isn't ours to read:
+    char * raw = new char[8];
+    std::memcpy(raw, "12345678", 8);
+    str v;
+    v.set_ref(raw, 0, 8);
+    v.append("tail");
+    STR_ASSERT( v == "12345678tail" );
+    STR_ASSERT( v.owns_buffer() == true );
+    delete[] raw;
 }
 
 void test_str_sized()
@@ -234,6 +473,34 @@ void test_str_sized()
     //
     // Compare different types of strings:
     //
+    //
+    // Move and swap use the local buffers directly:
+    //
+    str32 m1{ "short one" };
+    str32 m2{ "a string that has outgrown the str32 local buffer" };
+    STR_ASSERT( m1.using_local_buffer() == true  );
+    STR_ASSERT( m2.using_local_buffer() == false );
+
+    swap(m1, m2); // Mixed local/heap swap.
+    STR_ASSERT( m1 == "a string that has outgrown the str32 local buffer" );
+    STR_ASSERT( m2 == "short one" );
+    STR_ASSERT( m1.using_local_buffer() == false );
+    STR_ASSERT( m2.using_local_buffer() == true  );
+
+    str32 m3{ "another short" };
+    swap(m2, m3); // Both local.
+    STR_ASSERT( m2 == "another short" );
+    STR_ASSERT( m3 == "short one" );
+
+    str32 m4{ static_cast<str32 &&>(m1) }; // Move steals the heap block.
+    STR_ASSERT( m4 == "a string that has outgrown the str32 local buffer" );
+    STR_ASSERT( m1.empty() == true );
+    STR_ASSERT( m1.using_local_buffer() == true );
+
+    m1 = static_cast<str32 &&>(m3); // Move of a local-buffer string copies len+1 bytes.
+    STR_ASSERT( m1 == "short one" );
+    STR_ASSERT( m3.empty() == true );
+
     s256 = "Hey there bud!";
     s32  = "Hey there friend!";
     STR_ASSERT( s32 != s256 );
@@ -244,6 +511,683 @@ void test_str_sized()
     STR_ASSERT( s256.ends_with("bud!") == true );
 }
 
+void test_str_tokenizer()
+{
+    const str csv{ ",,alpha,beta;;gamma," };
+    str_tokenizer tokenizer{ csv, ",;" };
+
+    str_ref token{ "" };
+    STR_ASSERT( tokenizer.next_token(token) == true );
+    STR_ASSERT( token == str{ "alpha" } );
+    STR_ASSERT( token.data() == csv.data() + 2 ); // Zero-copy view into the source.
+
+    STR_ASSERT( tokenizer.next_token(token) == true );
+    STR_ASSERT( token == str{ "beta" } );
+    STR_ASSERT( tokenizer.next_token(token) == true );
+    STR_ASSERT( token == str{ "gamma" } );
+    STR_ASSERT( tokenizer.next_token(token) == false );
+
+    // The input buffer is never modified (no strtok-style null stores):
+    STR_ASSERT( csv == ",,alpha,beta;;gamma," );
+
+    // Range-for support (begin() rewinds):
+    int count = 0;
+    int total_chars = 0;
+    for (const str_ref t : tokenizer)
+    {
+        ++count;
+        total_chars += t.length();
+    }
+    STR_ASSERT( count == 3 );
+    STR_ASSERT( total_chars == 14 ); // alpha + beta + gamma
+
+    // Delimiter-only and empty inputs yield nothing:
+    str_tokenizer empty_tok{ ";;;;", 4, ";" };
+    STR_ASSERT( empty_tok.next_token(token) == false );
+}
+
+void test_str_big_capacity()
+{
+    // Grow a string well past the 21-bit capacity bitfield limit (2 MB);
+    // the real capacity spills into a block header transparently.
+    const int chunk_size = 256 * 1024;
+    str chunk;
+    chunk.resize(chunk_size, 'x');
+
+    str s{ "start-" };
+    for (int i = 0; i < 16; ++i) // 4 MB total
+    {
+        s += chunk;
+    }
+
+    const int expected_length = 6 + (16 * chunk_size);
+    STR_ASSERT( s.length()   == expected_length );
+    STR_ASSERT( s.capacity() >= expected_length + 1 );
+    STR_ASSERT( s.starts_with("start-") == true );
+    STR_ASSERT( s[3 * 1024 * 1024] == 'x' );
+
+    s += "-end";
+    STR_ASSERT( s.ends_with("-end") == true );
+
+    // shrink_to_fit keeps a spilled block intact:
+    s.shrink_to_fit();
+    STR_ASSERT( s.capacity() == s.length() + 1 );
+    STR_ASSERT( s.ends_with("-end") == true );
+
+    // Copies and moves of huge strings:
+    str copy{ s };
+    STR_ASSERT( copy.length() == s.length() );
+    STR_ASSERT( copy.ends_with("-end") == true );
+
+    str moved{ static_cast<str &&>(copy) };
+    STR_ASSERT( moved.length() == s.length() );
+    STR_ASSERT( moved[1024 * 1024] == 'x' );
+
+    // clear() releases the spilled block cleanly:
+    s.clear();
+    STR_ASSERT( s.capacity() == 0 );
+
+    // reserve_discard straight past the limit:
+    s.reserve_discard(3 * 1024 * 1024);
+    STR_ASSERT( s.capacity() >= 3 * 1024 * 1024 );
+    STR_ASSERT( s.empty() == true );
+}
+
+void test_str_concat()
+{
+    const str dir{ "assets/textures" };
+    const str64 name{ "grass" };
+    const std::string extension{ "png" };
+
+    // Multi-operand expression materializes with a single allocation:
+    const str path = dir + "/" + name + "." + extension;
+    STR_ASSERT( path == "assets/textures/grass.png" );
+    STR_ASSERT( path.length() == 25 );
+
+    // Leading literal / std::string operands:
+    str s = "prefix-" + name;
+    STR_ASSERT( s == "prefix-grass" );
+    s = extension + str{ "!" };
+    STR_ASSERT( s == "png!" );
+
+    // Assigning over an existing string reuses its buffer when it fits:
+    s.reserve(128);
+    const char * const old_buffer = s.c_str();
+    s = dir + "/" + name;
+    STR_ASSERT( s == "assets/textures/grass" );
+    STR_ASSERT( s.c_str() == old_buffer );
+
+    // str_ref slices concatenate without copies until materialization:
+    const str_ref slice{ "xxgrassxx", 2, 5 };
+    s = str{ "<" } + slice + ">";
+    STR_ASSERT( s == "<grass>" );
+
+    // Small results land in a str_sized local buffer:
+    str32 small = name + "." + extension;
+    STR_ASSERT( small == "grass.png" );
+    STR_ASSERT( small.using_local_buffer() == true );
+}
+
+void test_str_number_parse()
+{
+    long long ll           = -1;
+    unsigned long long ull = 0;
+    double d               = 0.0;
+    float f                = 0.0f;
+
+    STR_ASSERT( str{ "12345" }.to_int(ll)   == true && ll == 12345   );
+    STR_ASSERT( str{ "-98765" }.to_int(ll)  == true && ll == -98765  );
+    STR_ASSERT( str{ "+42" }.to_int(ll)     == true && ll == 42      );
+    STR_ASSERT( str{ "0" }.to_int(ll)       == true && ll == 0       );
+    STR_ASSERT( str{ "12345" }.to_uint(ull) == true && ull == 12345u );
+
+    // The full 64-bit range round-trips through the formatters:
+    str s;
+    s.set_int(-9223372036854775807ll - 1);
+    STR_ASSERT( s.to_int(ll) == true && ll == -9223372036854775807ll - 1 );
+    s.set_uint(18446744073709551615ull);
+    STR_ASSERT( s.to_uint(ull) == true && ull == 18446744073709551615ull );
+
+    // One past the limits must overflow, not wrap:
+    STR_ASSERT( str{ "9223372036854775808" }.to_int(ll)    == false );
+    STR_ASSERT( str{ "-9223372036854775809" }.to_int(ll)   == false );
+    STR_ASSERT( str{ "18446744073709551616" }.to_uint(ull) == false );
+
+    // Rejected inputs leave the output untouched:
+    ll = 777;
+    STR_ASSERT( str{ "" }.to_int(ll)      == false );
+    STR_ASSERT( str{ "12x3" }.to_int(ll)  == false );
+    STR_ASSERT( str{ " 12" }.to_int(ll)   == false ); // No whitespace skipping.
+    STR_ASSERT( str{ "12 " }.to_int(ll)   == false );
+    STR_ASSERT( str{ "-" }.to_int(ll)     == false );
+    STR_ASSERT( str{ "-5" }.to_uint(ull)  == false ); // No negative unsigned.
+    STR_ASSERT( ll == 777 );
+
+    // Floats - plain, fractional, exponent, signs:
+    STR_ASSERT( str{ "2.5" }.to_double(d)      == true && d == 2.5      );
+    STR_ASSERT( str{ "-0.125" }.to_double(d)   == true && d == -0.125   );
+    STR_ASSERT( str{ "1e3" }.to_double(d)      == true && d == 1000.0   );
+    STR_ASSERT( str{ "2.5E-2" }.to_double(d)   == true && d == 0.025    );
+    STR_ASSERT( str{ "+12.0" }.to_double(d)    == true && d == 12.0     );
+    STR_ASSERT( str{ "42" }.to_double(d)       == true && d == 42.0     );
+    STR_ASSERT( str{ ".5" }.to_double(d)       == true && d == 0.5      );
+    STR_ASSERT( str{ "2.5" }.to_float(f)       == true && f == 2.5f     );
+
+    STR_ASSERT( str{ "1e" }.to_double(d)    == false );
+    STR_ASSERT( str{ "." }.to_double(d)     == false );
+    STR_ASSERT( str{ "1.2.3" }.to_double(d) == false );
+    STR_ASSERT( str{ "nope" }.to_double(d)  == false );
+
+    // The bounded static versions don't read past 'len':
+    STR_ASSERT( str::to_int("123456", 3, ll) == true && ll == 123 );
+    STR_ASSERT( str::to_double("2.75xx", 4, d) == true && d == 2.75 );
+}
+
+void test_str_number_format()
+{
+    str s;
+
+    s.set_int(0);
+    STR_ASSERT( s == "0" );
+    s.set_int(-42);
+    STR_ASSERT( s == "-42" );
+    s.set_int(1234567890123456789ll);
+    STR_ASSERT( s == "1234567890123456789" );
+    s.set_int(-9223372036854775807ll - 1); // LLONG_MIN
+    STR_ASSERT( s == "-9223372036854775808" );
+
+    s.set_uint(18446744073709551615ull); // ULLONG_MAX
+    STR_ASSERT( s == "18446744073709551615" );
+
+    s.set_hex(0);
+    STR_ASSERT( s == "0" );
+    s.set_hex(0xDEADBEEFull);
+    STR_ASSERT( s == "deadbeef" );
+    s.set_hex(0xDEADBEEFull, true);
+    STR_ASSERT( s == "DEADBEEF" );
+
+    s.set_float(0.0);
+    STR_ASSERT( s == "0.000000" );
+    s.set_float(-2.5, 2);
+    STR_ASSERT( s == "-2.50" );
+    s.set_float(3.14159, 3);
+    STR_ASSERT( s == "3.142" );
+    s.set_float(1.0, 0);
+    STR_ASSERT( s == "1" );
+    s.set_float(0.0625, 4);
+    STR_ASSERT( s == "0.0625" );
+    s.set_float(9.999, 2); // Rounds up and carries into the integer part.
+    STR_ASSERT( s == "10.00" );
+
+    // Append variants compose and match the setf output:
+    s.clear_no_free();
+    s.append_int(7) += '=';
+    s.append_uint(7u) += ' ';
+    s.append_hex(255);
+    STR_ASSERT( s == "7=7 ff" );
+
+    str reference;
+    reference.setf("%d=%u %x", 7, 7u, 255);
+    STR_ASSERT( s == reference );
+
+    // Padded fields, matching the printf conventions for the fill:
+    s.clear_no_free();
+    s.append_padded(7, 4);
+    STR_ASSERT( s == "0007" );
+    s.clear_no_free();
+    s.append_padded(-7, 4);      // Sign before the zeros, like "%04d".
+    STR_ASSERT( s == "-007" );
+    s.clear_no_free();
+    s.append_padded(-7, 4, ' '); // Sign after the spaces, like "%4d".
+    STR_ASSERT( s == "  -7" );
+    s.clear_no_free();
+    s.append_padded(12345, 3);   // Wider than the field: no truncation.
+    STR_ASSERT( s == "12345" );
+    s.clear_no_free();
+    s.append_padded(0, 6, '*');
+    STR_ASSERT( s == "*****0" );
+
+    // A fixed timestamp layout composed from padded fields comes out
+    // identical to the appendf() it replaces:
+    s.clear_no_free();
+    s.append_padded(2026, 4) += '-';
+    s.append_padded(8, 2) += '-';
+    s.append_padded(30, 2) += 'T';
+    s.append_padded(9, 2) += ':';
+    s.append_padded(5, 2) += ':';
+    s.append_padded(59, 2) += '.';
+    s.append_padded(12345, 6) += 'Z';
+
+    reference.setf("%04d-%02d-%02dT%02d:%02d:%02d.%06dZ", 2026, 8, 30, 9, 5, 59, 12345);
+    STR_ASSERT( s == reference );
+}
+
+void test_str_array()
+{
+    str_array array;
+    STR_ASSERT( array.size()  == 0    );
+    STR_ASSERT( array.empty() == true );
+
+    array.push_back("first");
+    array.push_back(str{ "second" });
+    array.push_back(std::string{ "third" });
+    array.push_back("bounded-xxxx", 7);
+    array.push_back(""); // Empty entries are fine.
+
+    STR_ASSERT( array.size() == 5 );
+    STR_ASSERT( array[0] == str{ "first"   } );
+    STR_ASSERT( array[1] == str{ "second"  } );
+    STR_ASSERT( array[2] == str{ "third"   } );
+    STR_ASSERT( array[3] == str{ "bounded" } );
+    STR_ASSERT( array[4].length() == 0 );
+
+    // Entries are proper null-terminated C strings inside one block:
+    STR_ASSERT( str::compare(array[1].c_str(), "second") == 0 );
+    STR_ASSERT( array[1].data() > array[0].data() );
+    STR_ASSERT( array[1].data() < array[0].data() + array.character_bytes() );
+
+    // Range-for iteration:
+    int count = 0;
+    int total_chars = 0;
+    for (const str_ref entry : array)
+    {
+        ++count;
+        total_chars += entry.length();
+    }
+    STR_ASSERT( count == 5 );
+    STR_ASSERT( total_chars == 23 );
+
+    // Many entries, still one growable block:
+    for (int i = 0; i < 10000; ++i)
+    {
+        array.push_back("key");
+    }
+    STR_ASSERT( array.size() == 10005 );
+    STR_ASSERT( array[10004] == str{ "key" } );
+
+    array.shrink_to_fit();
+    STR_ASSERT( array.character_capacity() == array.character_bytes() );
+    STR_ASSERT( array[10004] == str{ "key" } );
+
+    array.clear();
+    STR_ASSERT( array.size() == 0 );
+    array.push_back("reused");
+    STR_ASSERT( array[0] == str{ "reused" } );
+}
+
+void test_str_line_reader()
+{
+    // Mixed Unix/Windows endings, empty line, no trailing newline:
+    const str text{ "first\nsecond\r\n\nlast" };
+    str_line_reader reader{ text };
+    str_ref line{ "" };
+
+    STR_ASSERT( reader.next_line(line) == true );
+    STR_ASSERT( line == str{ "first" } );
+
+    STR_ASSERT( reader.next_line(line) == true );
+    STR_ASSERT( line == str{ "second" } ); // '\r' stripped.
+
+    STR_ASSERT( reader.next_line(line) == true );
+    STR_ASSERT( line.length() == 0 ); // Empty line preserved.
+
+    STR_ASSERT( reader.next_line(line) == true );
+    STR_ASSERT( line == str{ "last" } ); // Final line without '\n'.
+
+    STR_ASSERT( reader.next_line(line) == false );
+
+    // Streaming: a line split across three chunks gets stitched back up.
+    const char chunk_a[] = "alpha\nbra";
+    const char chunk_b[] = "vo\ncha";
+    const char chunk_c[] = "rlie\n";
+
+    str_line_reader stream{ chunk_a, static_cast<int>(sizeof(chunk_a) - 1), false };
+
+    STR_ASSERT( stream.next_line(line) == true );
+    STR_ASSERT( line == str{ "alpha" } );
+
+    STR_ASSERT( stream.next_line(line) == false ); // "bra" withheld.
+    STR_ASSERT( stream.has_partial_line() == true );
+
+    stream.refill(chunk_b, static_cast<int>(sizeof(chunk_b) - 1), false);
+    STR_ASSERT( stream.next_line(line) == true );
+    STR_ASSERT( line == str{ "bravo" } ); // Stitched across the refill.
+
+    STR_ASSERT( stream.next_line(line) == false ); // "cha" withheld.
+
+    stream.refill(chunk_c, static_cast<int>(sizeof(chunk_c) - 1), true);
+    STR_ASSERT( stream.next_line(line) == true );
+    STR_ASSERT( line == str{ "charlie" } );
+
+    STR_ASSERT( stream.next_line(line) == false );
+    STR_ASSERT( stream.has_partial_line() == false );
+
+    // A carried '\r' that meets its '\n' in the next chunk is stripped:
+    const char cr_a[] = "dash\r";
+    const char cr_b[] = "\ndot";
+    str_line_reader cr_stream{ cr_a, static_cast<int>(sizeof(cr_a) - 1), false };
+
+    STR_ASSERT( cr_stream.next_line(line) == false );
+    cr_stream.refill(cr_b, static_cast<int>(sizeof(cr_b) - 1), true);
+
+    STR_ASSERT( cr_stream.next_line(line) == true );
+    STR_ASSERT( line == str{ "dash" } );
+    STR_ASSERT( cr_stream.next_line(line) == true );
+    STR_ASSERT( line == str{ "dot" } );
+    STR_ASSERT( cr_stream.next_line(line) == false );
+}
+
+void test_str_intern()
+{
+    str_intern_table table;
+    STR_ASSERT( table.size() == 0 );
+
+    const char * foo_a = table.intern("foo");
+    const char * bar   = table.intern("bar");
+    const char * foo_b = table.intern(str{ "foo" });
+
+    // Equal contents yield the same canonical pointer:
+    STR_ASSERT( foo_a == foo_b );
+    STR_ASSERT( foo_a != bar   );
+    STR_ASSERT( table.size() == 2 );
+
+    // Interned strings are proper null-terminated copies:
+    STR_ASSERT( str::compare(foo_a, "foo") == 0 );
+    STR_ASSERT( str::compare(bar,   "bar") == 0 );
+
+    // The bounded overload doesn't read past the given length:
+    const char * pre = table.intern("foobar", 3);
+    STR_ASSERT( pre == foo_a );
+    STR_ASSERT( table.size() == 2 );
+
+    // Pointers must remain stable across table growth:
+    str key;
+    for (int i = 0; i < 1000; ++i)
+    {
+        key.setf("identifier_%d", i);
+        table.intern(key);
+    }
+    STR_ASSERT( table.size() == 1002 );
+    STR_ASSERT( table.intern("foo") == foo_a );
+    STR_ASSERT( table.intern("identifier_0") == table.intern("identifier_0") );
+}
+
+void test_str_bulk()
+{
+    const int count = 100;
+    str strings[count];
+    for (int i = 0; i < count; ++i)
+    {
+        strings[i].setf("  Entry Number %d  ", i);
+    }
+
+    // Sharded across 4 workers; results must match the serial path:
+    str_bulk::trim(strings, strings + count, 4);
+    str_bulk::to_lower(strings, strings + count, 4);
+
+    str expected;
+    for (int i = 0; i < count; ++i)
+    {
+        expected.setf("entry number %d", i);
+        STR_ASSERT( strings[i] == expected );
+    }
+
+    str_bulk::to_upper(strings, strings + count, 3);
+    STR_ASSERT( strings[0]         == "ENTRY NUMBER 0"  );
+    STR_ASSERT( strings[count - 1] == "ENTRY NUMBER 99" );
+
+    // find_first returns the overall first match, regardless of which
+    // shard found one:
+    strings[17] += " needle";
+    strings[80] += " needle";
+    STR_ASSERT( str_bulk::find_first(strings, strings + count, "needle", 4) == 17 );
+    STR_ASSERT( str_bulk::find_first(strings, strings + count, "needle", 1) == 17 );
+    STR_ASSERT( str_bulk::find_first(strings, strings + count, "no such", 4) == -1 );
+
+    // Custom kernels go through for_each():
+    str_bulk::for_each(strings, strings + count, 4, [](str & s) { s.truncate(5); });
+    STR_ASSERT( strings[42] == "ENTRY" );
+
+    // Degenerate inputs - empty range, more threads than entries:
+    str_bulk::to_lower(strings, strings, 8);
+    str_bulk::to_lower(strings, strings + 2, 16);
+    STR_ASSERT( strings[0] == "entry" );
+    STR_ASSERT( strings[1] == "entry" );
+    STR_ASSERT( strings[2] == "ENTRY" );
+}
+
+void test_str_stats()
+{
+    // The suite compiles with STR_ENABLE_STATS, so every string in the
+    // tests above already went through the counting layer - here we
+    // just check that the numbers add up.
+    str_reset_stats();
+    {
+        str s;
+        s = "long enough to go to the heap, well past any local buffer";
+
+        str_stats stats = str_get_stats();
+        STR_ASSERT( stats.alloc_calls           == 1 );
+        STR_ASSERT( stats.reserve_discard_grows == 1 );
+        STR_ASSERT( stats.reserve_grows         == 0 );
+        STR_ASSERT( stats.bytes_requested >= static_cast<std::uint64_t>(s.length() + 1) );
+        STR_ASSERT( stats.live_bytes      == stats.bytes_requested );
+        STR_ASSERT( stats.peak_live_bytes == stats.live_bytes );
+
+        // Growing appends funnel through reserve():
+        while (s.length() < 4096)
+        {
+            s += "12345678";
+        }
+        stats = str_get_stats();
+        STR_ASSERT( stats.reserve_grows   >= 1 );
+        STR_ASSERT( stats.realloc_calls   >= 1 );
+        STR_ASSERT( stats.peak_live_bytes >= 4096 );
+        STR_ASSERT( stats.live_bytes      <= stats.peak_live_bytes );
+    }
+
+    // Destruction returns every byte:
+    str_stats stats = str_get_stats();
+    STR_ASSERT( stats.free_calls >= 1 );
+    STR_ASSERT( stats.live_bytes == 0  );
+
+    // A disowned string re-reserving into its local buffer is an SSO hit:
+    str_reset_stats();
+    str64 small;
+    small.set_ref("borrowed for a moment");
+    small = "owned again";
+    stats = str_get_stats();
+    STR_ASSERT( stats.local_buffer_grows == 1 );
+    STR_ASSERT( stats.alloc_calls        == 0 );
+
+    // reset re-bases live bytes on the blocks still allocated:
+    const str survivor{ "a string that outlives the counter reset" };
+    str_reset_stats();
+    stats = str_get_stats();
+    STR_ASSERT( stats.alloc_calls     == 0 );
+    STR_ASSERT( stats.live_bytes      >  0 );
+    STR_ASSERT( stats.peak_live_bytes == stats.live_bytes );
+}
+
+void test_str_utf8()
+{
+    const str plain{ "just plain ASCII text, long enough for the word-sized loop" };
+    STR_ASSERT( plain.is_ascii()      == true );
+    STR_ASSERT( plain.validate_utf8() == true );
+
+    const str empty;
+    STR_ASSERT( empty.is_ascii()      == true );
+    STR_ASSERT( empty.validate_utf8() == true );
+
+    // Well-formed sequences of every length (2, 3 and 4 bytes):
+    const str multi{ "caf\xC3\xA9 \xE2\x82\xAC 42 \xF0\x9D\x84\x9E" };
+    STR_ASSERT( multi.is_ascii()      == false );
+    STR_ASSERT( multi.validate_utf8() == true  );
+
+    // Malformed inputs the validator must reject:
+    STR_ASSERT( str::validate_utf8("\x80",             1) == false ); // Stray continuation byte.
+    STR_ASSERT( str::validate_utf8("\xC0\xAF",         2) == false ); // Overlong 2-byte encoding.
+    STR_ASSERT( str::validate_utf8("\xE0\x80\xAF",     3) == false ); // Overlong 3-byte encoding.
+    STR_ASSERT( str::validate_utf8("\xED\xA0\x80",     3) == false ); // UTF-16 surrogate half.
+    STR_ASSERT( str::validate_utf8("\xF4\x90\x80\x80", 4) == false ); // Above U+10FFFF.
+    STR_ASSERT( str::validate_utf8("\xF5\x80\x80\x80", 4) == false ); // Invalid lead byte.
+    STR_ASSERT( str::validate_utf8("\xE2\x82",         2) == false ); // Truncated sequence.
+    STR_ASSERT( str::validate_utf8("ok \xC3\x28",      5) == false ); // Bad continuation byte.
+
+    // append_validated() copies and validates in one pass:
+    str s{ "log: " };
+    STR_ASSERT( s.append_validated(multi.c_str(), multi.length()) == true );
+    STR_ASSERT( s.length() == 5 + multi.length() );
+    STR_ASSERT( s.ends_with(multi.c_str()) );
+
+    // A rejected append leaves the string exactly as it was:
+    const str before{ s };
+    STR_ASSERT( s.append_validated("bad \xED\xA0\x80 tail", 12) == false );
+    STR_ASSERT( s == before );
+    STR_ASSERT( s.length() == before.length() );
+}
+
+void test_str_shared()
+{
+    const char * payload = "a payload big enough that copying it per consumer would hurt";
+
+    str_shared original{ payload };
+    STR_ASSERT( original == payload );
+    STR_ASSERT( original.is_shared() );
+    STR_ASSERT( original.ref_count() == 1 );
+
+    // Copies share the block - same characters, bumped refcount:
+    str_shared copy_a{ original };
+    str_shared copy_b = copy_a;
+    STR_ASSERT( copy_a.c_str() == original.c_str() );
+    STR_ASSERT( copy_b.c_str() == original.c_str() );
+    STR_ASSERT( original.ref_count() == 3 );
+
+    // A growing mutation detaches into a private buffer:
+    copy_a += " (annotated)";
+    STR_ASSERT( !copy_a.is_shared() );
+    STR_ASSERT( copy_a.c_str() != original.c_str() );
+    str expected{ payload };
+    expected += " (annotated)";
+    STR_ASSERT( copy_a == expected );
+    STR_ASSERT( original == payload ); // Other references untouched.
+
+    // The mutated copy keeps its block reference until it is
+    // destroyed or reassigned - only the characters detached:
+    STR_ASSERT( original.ref_count() == 3 );
+    copy_a = str_shared{};
+    STR_ASSERT( original.ref_count() == 2 );
+
+    // detach() forces a private copy for in-place writes:
+    copy_b.detach();
+    STR_ASSERT( !copy_b.is_shared() );
+    STR_ASSERT( copy_b.c_str() != original.c_str() );
+    copy_b.to_upper();
+    STR_ASSERT( original == payload );
+    STR_ASSERT( original.ref_count() == 1 );
+
+    // Copying a detached string starts a fresh shared block:
+    str_shared reshared{ copy_b };
+    STR_ASSERT( reshared.is_shared() );
+    STR_ASSERT( reshared.ref_count() == 1 );
+    STR_ASSERT( reshared == copy_b );
+
+    // Moves transfer the reference without touching the count:
+    str_shared moved{ static_cast<str_shared &&>(reshared) };
+    STR_ASSERT( moved.is_shared() );
+    STR_ASSERT( moved.ref_count() == 1 );
+    STR_ASSERT( reshared.empty() );
+
+    moved = str_shared{ original };
+    STR_ASSERT( moved.c_str() == original.c_str() );
+    STR_ASSERT( original.ref_count() == 2 );
+
+    // Destruction releases; the last reference frees the block:
+    {
+        str_shared last_copy{ original };
+        STR_ASSERT( original.ref_count() == 3 );
+    }
+    STR_ASSERT( original.ref_count() == 2 );
+
+    // Empty strings never allocate a block:
+    str_shared empty;
+    STR_ASSERT( !empty.is_shared() );
+    STR_ASSERT( empty.ref_count() == 0 );
+    STR_ASSERT( empty.empty() );
+}
+
+void test_str_builder()
+{
+    str_builder builder;
+    STR_ASSERT( builder.total_length()   == 0 );
+    STR_ASSERT( builder.fragment_count() == 0 );
+
+    const str str_frag{ "str " };
+    const std::string std_string{ "std" };
+    builder.append("C string ")
+           .append(str_frag)
+           .append(std_string)
+           .append(' ')
+           .append_int(-42)
+           .append(' ')
+           .append_uint(1234567890u)
+           .append(' ')
+           .append_float(2.5, 2);
+
+    STR_ASSERT( builder.fragment_count() == 9 );
+
+    str result;
+    builder.to_string(result);
+    STR_ASSERT( result == "C string str std -42 1234567890 2.50" );
+    STR_ASSERT( result.length() == builder.total_length() );
+
+    // reset() drops the fragments but keeps the builder usable:
+    builder.reset();
+    STR_ASSERT( builder.total_length()   == 0 );
+    STR_ASSERT( builder.fragment_count() == 0 );
+
+    builder.append("again");
+    builder.to_string(result);
+    STR_ASSERT( result == "again" );
+
+    // Push enough fragments to overflow the local fragment array:
+    builder.reset();
+    for (int i = 0; i < 100; ++i)
+    {
+        builder.append("ab");
+    }
+    builder.to_string(result);
+    STR_ASSERT( result.length() == 200 );
+}
+
+void test_str_arena()
+{
+    str_arena arena{ 1024 };
+    str_allocator * prev = str_set_allocator(arena.allocator());
+    STR_ASSERT( str_get_allocator() == arena.allocator() );
+
+    {
+        str s{ "this string is long enough to need a heap allocation from the arena" };
+        STR_ASSERT( s.length() == 67 );
+        STR_ASSERT( s.owns_buffer() == true );
+        STR_ASSERT( arena.allocated_bytes() > 0 );
+
+        // Grow it a few times - all blocks come from the arena.
+        for (int i = 0; i < 100; ++i)
+        {
+            s += "-more";
+        }
+        STR_ASSERT( s.length() == 567 );
+        STR_ASSERT( s.ends_with("-more") == true );
+    } // s destroyed here; arena frees are no-ops.
+
+    str_set_allocator(prev);
+    STR_ASSERT( str_get_allocator() == prev );
+
+    arena.release_all();
+    STR_ASSERT( arena.allocated_bytes() == 0 );
+}
+
 } // namespace unittest {}
 
 // ========================================================
@@ -262,8 +1206,24 @@ int main()
     std::printf("---- Running unit tests for the str classes ----\n");
 
     STR_TEST(str_basics);
+    STR_TEST(str_binary);
+    STR_TEST(str_concat);
+    STR_TEST(str_big_capacity);
     STR_TEST(str_ref);
+    STR_TEST(str_tokenizer);
+    STR_TEST(str_line_reader);
+    STR_TEST(str_hash);
     STR_TEST(str_sized);
+    STR_TEST(str_number_format);
+    STR_TEST(str_number_parse);
+    STR_TEST(str_arena);
+    STR_TEST(str_builder);
+    STR_TEST(str_array);
+    STR_TEST(str_intern);
+    STR_TEST(str_shared);
+    STR_TEST(str_utf8);
+    STR_TEST(str_bulk);
+    STR_TEST(str_stats);
     // Should add more tests here!
 
     std::printf("All passed.\n");